@@ -0,0 +1,683 @@
+/*
+ * c7evbench.cpp
+ *
+ * Copyright (c) 2025 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ */
+
+
+#include <c7app.hpp>
+#include <c7args.hpp>
+#include <c7event/acceptor_impl.hpp>
+#include <c7event/msgbuf_impl.hpp>
+#include <c7event/portgroup.hpp>
+#include <c7nseq/flat.hpp>
+#include <c7nseq/string.hpp>
+#include <c7nseq/transform.hpp>
+#include <c7socket.hpp>
+#include <c7thread/condvar.hpp>
+#include <c7thread/thread.hpp>
+#include <c7utils/time.hpp>
+#include <_c7version.hpp>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+
+
+using c7::p_;
+
+
+/*----------------------------------------------------------------------------
+                                configuration
+----------------------------------------------------------------------------*/
+
+struct bench_conf {
+    c7::strvec suites;			// echo, pipeline, idle, fanout
+    c7::strvec transports;		// tcp, unix
+    size_t count = 100000;		// messages (echo, pipeline)
+    size_t size = 64;			// payload bytes
+    size_t window = 256;		// outstanding messages (pipeline)
+    size_t idle_conns = 10000;		// idle connections (idle)
+    size_t subscribers = 100;		// subscribers (fanout)
+    size_t rounds = 1000;		// broadcasts (fanout)
+    bool json = false;
+};
+
+static const c7::strvec all_suites{"echo", "pipeline", "idle", "fanout"};
+static const c7::strvec all_transports{"tcp", "unix"};
+
+
+class bench_args: public c7::args::parser {
+public:
+    bench_args(bench_conf& conf): conf_(conf) {}
+    c7::result<> init() override;
+
+private:
+    bench_conf& conf_;
+
+    callback_t opt_suite;
+    callback_t opt_transport;
+    callback_t opt_count;
+    callback_t opt_size;
+    callback_t opt_window;
+    callback_t opt_idle;
+    callback_t opt_subscribers;
+    callback_t opt_rounds;
+    callback_t opt_json;
+    callback_t opt_help;
+};
+
+c7::result<>
+bench_args::init()
+{
+    c7::result<> res;
+    {
+	opt_desc d;
+	d.long_name	= "suite";
+	d.short_name	= "s";
+	d.type		= opt_desc::prm_type::KEY;
+	d.keys		= all_suites;
+	d.opt_descrip	= "benchmark suite (default: all)";
+	d.prm_name	= "SUITE";
+	d.prm_descrip	= "suite name";
+	d.prmc_min	= 1;
+	d.prmc_max	= -1U;
+	res << add_opt(d, &bench_args::opt_suite);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "transport";
+	d.short_name	= "t";
+	d.type		= opt_desc::prm_type::KEY;
+	d.keys		= all_transports;
+	d.opt_descrip	= "transport (default: all)";
+	d.prm_name	= "TRANSPORT";
+	d.prm_descrip	= "transport name";
+	d.prmc_min	= 1;
+	d.prmc_max	= -1U;
+	res << add_opt(d, &bench_args::opt_transport);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "count";
+	d.short_name	= "n";
+	d.type		= opt_desc::prm_type::UINT;
+	d.opt_descrip	= "number of messages of echo and pipeline";
+	d.prm_name	= "COUNT";
+	d.prm_descrip	= "messages (default: 100000)";
+	d.prmc_min	= 1;
+	d.prmc_max	= 1;
+	res << add_opt(d, &bench_args::opt_count);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "size";
+	d.short_name	= "z";
+	d.type		= opt_desc::prm_type::UINT;
+	d.opt_descrip	= "payload bytes of message";
+	d.prm_name	= "BYTES";
+	d.prm_descrip	= "bytes (default: 64, minimum: 8)";
+	d.prmc_min	= 1;
+	d.prmc_max	= 1;
+	res << add_opt(d, &bench_args::opt_size);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "window";
+	d.short_name	= "w";
+	d.type		= opt_desc::prm_type::UINT;
+	d.opt_descrip	= "outstanding messages of pipeline";
+	d.prm_name	= "COUNT";
+	d.prm_descrip	= "messages (default: 256)";
+	d.prmc_min	= 1;
+	d.prmc_max	= 1;
+	res << add_opt(d, &bench_args::opt_window);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "idle";
+	d.short_name	= "i";
+	d.type		= opt_desc::prm_type::UINT;
+	d.opt_descrip	= "idle connections of idle (limited by RLIMIT_NOFILE)";
+	d.prm_name	= "COUNT";
+	d.prm_descrip	= "connections (default: 10000)";
+	d.prmc_min	= 1;
+	d.prmc_max	= 1;
+	res << add_opt(d, &bench_args::opt_idle);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "subscribers";
+	d.short_name	= "f";
+	d.type		= opt_desc::prm_type::UINT;
+	d.opt_descrip	= "subscribers of fanout";
+	d.prm_name	= "COUNT";
+	d.prm_descrip	= "connections (default: 100)";
+	d.prmc_min	= 1;
+	d.prmc_max	= 1;
+	res << add_opt(d, &bench_args::opt_subscribers);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "rounds";
+	d.short_name	= "r";
+	d.type		= opt_desc::prm_type::UINT;
+	d.opt_descrip	= "broadcasts of fanout";
+	d.prm_name	= "COUNT";
+	d.prm_descrip	= "broadcasts (default: 1000)";
+	d.prmc_min	= 1;
+	d.prmc_max	= 1;
+	res << add_opt(d, &bench_args::opt_rounds);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "json";
+	d.short_name	= "j";
+	d.opt_descrip	= "print results as JSON lines";
+	res << add_opt(d, &bench_args::opt_json);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "help";
+	d.short_name	= "h";
+	d.opt_descrip	= "show this usage";
+	res << add_opt(d, &bench_args::opt_help);
+    }
+    return res;
+}
+
+c7::result<>
+bench_args::opt_suite(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    for (auto& v: vals) {
+	conf_.suites.push_back(all_suites[v.key_index]);
+    }
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_transport(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    for (auto& v: vals) {
+	conf_.transports.push_back(all_transports[v.key_index]);
+    }
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_count(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    conf_.count = std::max<size_t>(vals[0].u, 1);
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_size(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    conf_.size = std::max<size_t>(vals[0].u, sizeof(int64_t));
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_window(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    conf_.window = std::max<size_t>(vals[0].u, 1);
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_idle(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    conf_.idle_conns = vals[0].u;
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_subscribers(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    conf_.subscribers = std::max<size_t>(vals[0].u, 1);
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_rounds(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    conf_.rounds = std::max<size_t>(vals[0].u, 1);
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_json(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    conf_.json = true;
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_help(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    c7::strvec usage;
+    usage.push_back(c7::format("Usage: %{} [option ...]\n\n option:\n", c7::app::progname));
+    append_usage(usage, 2, 32);
+    auto s = usage
+	| c7::nseq::transform([](auto& s){ return s+"\n"; })
+	| c7::nseq::flat<1>()
+	| c7::nseq::to_string();
+    c7::drop = write(2, s.c_str(), s.size());
+    std::exit(0);
+    return c7result_ok();
+}
+
+
+/*----------------------------------------------------------------------------
+                                    result
+----------------------------------------------------------------------------*/
+
+// One result is printed as one line. JSON line has fixed keys so that results
+// of several releases can be compared by scripts.
+
+struct bench_result {
+    std::string suite;
+    std::string transport;
+    size_t n = 0;			// samples or messages
+    size_t size = 0;			// payload bytes
+    size_t conns = 0;			// connections used by suite
+    double elapsed_s = 0;
+    double msg_per_s = 0;
+    double mb_per_s = 0;
+    std::vector<int64_t> latency_ns;	// sorted by finish()
+    int64_t rss_kb_per_1k_conns = -1;	// idle only (both ends of connections)
+
+    void finish() {
+	std::sort(latency_ns.begin(), latency_ns.end());
+    }
+
+    int64_t percentile(double p) const {
+	if (latency_ns.empty()) {
+	    return 0;
+	}
+	auto i = static_cast<size_t>(latency_ns.size() * p / 100.0);
+	return latency_ns[std::min(i, latency_ns.size() - 1)];
+    }
+
+    void print(bool json) const {
+	if (json) {
+	    p_("{\"version\":\"%{}.%{}.%{}\",\"suite\":\"%{}\",\"transport\":\"%{}\","
+	       "\"n\":%{},\"size\":%{},\"conns\":%{},\"elapsed_s\":%{.6f},"
+	       "\"msg_per_s\":%{.1f},\"mb_per_s\":%{.3f},"
+	       "\"p50_ns\":%{},\"p90_ns\":%{},\"p99_ns\":%{},\"p999_ns\":%{},\"max_ns\":%{},"
+	       "\"rss_kb_per_1k_conns\":%{},\"rss_scope\":\"%{}\"}",
+	       C7XX_VERSION_MAJOR, C7XX_VERSION_MINOR, C7XX_VERSION_PATCH,
+	       suite, transport, n, size, conns, elapsed_s, msg_per_s, mb_per_s,
+	       percentile(50), percentile(90), percentile(99), percentile(99.9),
+	       latency_ns.empty() ? 0 : latency_ns.back(), rss_kb_per_1k_conns,
+	       (rss_kb_per_1k_conns >= 0) ? "client+server" : "");
+	} else {
+	    p_("%{<8} %{<4}  n:%{}, size:%{}, conns:%{}, %{.0f} msg/s, %{.1f} MB/s",
+	       suite, transport, n, size, conns, msg_per_s, mb_per_s);
+	    if (!latency_ns.empty()) {
+		p_("%{<8} %{<4}  latency[us] p50:%{.1f}, p90:%{.1f}, p99:%{.1f}, p99.9:%{.1f}, max:%{.1f}",
+		   suite, transport,
+		   percentile(50) / 1e3, percentile(90) / 1e3, percentile(99) / 1e3,
+		   percentile(99.9) / 1e3, latency_ns.back() / 1e3);
+	    }
+	    if (rss_kb_per_1k_conns >= 0) {
+		p_("%{<8} %{<4}  rss: %{} KiB / 1000 idle connections (client and server ends)",
+		   suite, transport, rss_kb_per_1k_conns);
+	    }
+	}
+    }
+};
+
+
+/*----------------------------------------------------------------------------
+                                    server
+----------------------------------------------------------------------------*/
+
+struct bench_header {
+    int32_t ev;
+    int32_t seq;
+};
+
+using bench_msgbuf = c7::event::multipart_msgbuf<bench_header, 1>;
+using bench_port = c7::event::socket_port;
+
+enum bench_event: int32_t {
+    EV_ECHO,		// server send back message
+    EV_SUB,		// server add the port to subscribers and send back message
+    EV_PUB,		// server broadcast message to subscribers
+};
+
+class bench_service: public c7::event::service_interface<bench_msgbuf> {
+public:
+    attach_id on_attached(monitor& mon, port_type& port, provider_hint hint) override {
+	auto id = service_interface::on_attached(mon, port, hint);
+	(void)port.tcp_nodelay(true);		// fail on UNIX domain socket
+	return id;
+    }
+
+    void on_message(monitor&, port_type& port, msgbuf_type& msg) override {
+	if (msg.header.ev == EV_ECHO) {
+	    (void)msg.send(port);
+	} else if (msg.header.ev == EV_SUB) {
+	    subscribers_.add(port);
+	    (void)msg.send(port);
+	} else if (msg.header.ev == EV_PUB) {
+	    (void)msg.send(subscribers_);
+	}
+    }
+
+private:
+    c7::event::portgroup<bench_port> subscribers_;	// used only by monitor thread
+};
+
+static c7::sockaddr_gen tcp_addr;
+static std::string unix_path;
+
+static void start_server()
+{
+    auto tcp_sock = c7::tcp_server("127.0.0.1", 0, 0, SOMAXCONN);
+    if (!tcp_sock) {
+	c7error(tcp_sock);
+    }
+    if (auto res = tcp_sock.value().self(); !res) {
+	c7error(res);
+    } else {
+	tcp_addr = res.value();
+    }
+
+    unix_path = c7::format("/tmp/c7evbench.%{}", ::getpid());
+    ::unlink(unix_path.c_str());
+    auto unix_sock = c7::unix_server(unix_path, SOMAXCONN);
+    if (!unix_sock) {
+	c7error(unix_sock);
+    }
+
+    auto svc = std::make_shared<bench_service>();
+    c7::result<> res;
+    res << c7::event::manage_acceptor(bench_port(std::move(tcp_sock.value())), svc);
+    res << c7::event::manage_acceptor(bench_port(std::move(unix_sock.value())), svc);
+    res << c7::event::start_thread();
+    if (!res) {
+	c7error(res);
+    }
+}
+
+static bench_port connect_client(const std::string& transport)
+{
+    auto sock = (transport == "tcp") ? c7::tcp_client(tcp_addr) : c7::unix_client(unix_path);
+    if (!sock) {
+	c7error(sock);
+    }
+    if (transport == "tcp") {
+	(void)sock.value().tcp_nodelay(true);
+    }
+    return bench_port(std::move(sock.value()));
+}
+
+
+/*----------------------------------------------------------------------------
+                                   clients
+----------------------------------------------------------------------------*/
+
+static void send_or_die(bench_msgbuf& msg, bench_port& port)
+{
+    if (auto io_res = msg.send(port); !io_res) {
+	c7error(io_res.get_result());
+    }
+}
+
+static void recv_or_die(bench_msgbuf& msg, bench_port& port)
+{
+    if (auto io_res = msg.recv(port); !io_res) {
+	c7error(io_res.get_result());
+    }
+}
+
+static void set_payload(bench_msgbuf& msg, std::vector<char>& payload)
+{
+    msg[1].iov_base = payload.data();
+    msg[1].iov_len = payload.size();
+}
+
+static void set_throughput(bench_result& r, int64_t beg_ns, int64_t end_ns)
+{
+    r.elapsed_s = (end_ns - beg_ns) / 1e9;
+    r.msg_per_s = r.n / r.elapsed_s;
+    r.mb_per_s = (r.n * r.size) / r.elapsed_s / (1024 * 1024);
+}
+
+// ping-pong latency over one connection
+static void measure_echo(bench_port& port, size_t count, size_t size, bench_result& r)
+{
+    std::vector<char> payload(size, 'e');
+    bench_msgbuf msg, rsp;
+    r.latency_ns.reserve(count);
+    auto beg = c7::monotonic_ns();
+    for (size_t i = 0; i < count; i++) {
+	msg.header = {EV_ECHO, static_cast<int32_t>(i)};
+	set_payload(msg, payload);
+	auto t0 = c7::monotonic_ns();
+	send_or_die(msg, port);
+	recv_or_die(rsp, port);
+	r.latency_ns.push_back(c7::monotonic_ns() - t0);
+    }
+    r.n = count;
+    r.size = size;
+    set_throughput(r, beg, c7::monotonic_ns());
+    r.finish();
+}
+
+static bench_result bench_echo(const bench_conf& conf, const std::string& transport)
+{
+    bench_result r{"echo", transport};
+    auto port = connect_client(transport);
+    r.conns = 1;
+    measure_echo(port, conf.count, conf.size, r);
+    return r;
+}
+
+// one sender thread keeps `window' messages outstanding, main thread receives.
+// latency is from sending a message until receiving its echo, so it includes
+// queueing behind the outstanding messages.
+static bench_result bench_pipeline(const bench_conf& conf, const std::string& transport)
+{
+    bench_result r{"pipeline", transport};
+    auto port = connect_client(transport);
+    r.conns = 1;
+    r.n = conf.count;
+    r.size = conf.size;
+
+    c7::thread::condvar cv;
+    size_t n_recv = 0;
+    auto sent_ns = std::make_unique<std::atomic<int64_t>[]>(conf.count);
+    r.latency_ns.reserve(conf.count);
+
+    c7::thread::thread sender;
+    sender.target([&]() {
+	std::vector<char> payload(conf.size, 'p');
+	bench_msgbuf msg;
+	for (size_t i = 0; i < conf.count; i++) {
+	    {
+		auto unlock = cv.lock();
+		cv.wait_while([&](){ return (i - n_recv) >= conf.window; });
+	    }
+	    msg.header = {EV_ECHO, static_cast<int32_t>(i)};
+	    set_payload(msg, payload);
+	    sent_ns[i] = c7::monotonic_ns();
+	    send_or_die(msg, port);
+	}
+    });
+
+    auto beg = c7::monotonic_ns();
+    if (auto res = sender.start(); !res) {
+	c7error(res);
+    }
+    bench_msgbuf rsp;
+    for (size_t i = 0; i < conf.count; i++) {
+	recv_or_die(rsp, port);
+	r.latency_ns.push_back(c7::monotonic_ns() - sent_ns[rsp.header.seq]);
+	auto unlock = cv.lock();
+	n_recv++;
+	cv.notify();
+    }
+    set_throughput(r, beg, c7::monotonic_ns());
+    sender.join();
+    r.finish();
+    return r;
+}
+
+static size_t raise_nofile()
+{
+    ::rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+	return 1024;
+    }
+    rl.rlim_cur = rl.rlim_max;
+    (void)::setrlimit(RLIMIT_NOFILE, &rl);
+    (void)::getrlimit(RLIMIT_NOFILE, &rl);
+    return rl.rlim_cur;
+}
+
+static int64_t rss_kb()
+{
+    long pages = 0, rss = 0;
+    if (auto fp = std::fopen("/proc/self/statm", "r"); fp != nullptr) {
+	if (std::fscanf(fp, "%ld %ld", &pages, &rss) != 2) {
+	    rss = 0;
+	}
+	std::fclose(fp);
+    }
+    return rss * (::sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// echo latency while many idle connections are managed by the same monitor
+static bench_result bench_idle(const bench_conf& conf, const std::string& transport)
+{
+    bench_result r{"idle", transport};
+
+    // both ends of connection are in this process
+    size_t limit = raise_nofile();
+    size_t n_idle = std::min(conf.idle_conns, (limit > 256) ? (limit - 256) / 2 : 0);
+
+    auto rss_beg = rss_kb();
+    std::vector<bench_port> idles;
+    idles.reserve(n_idle);
+    for (size_t i = 0; i < n_idle; i++) {
+	idles.push_back(connect_client(transport));
+    }
+    // wait until server accepts all (echo is served after pending accepts)
+    auto port = connect_client(transport);
+    size_t count = std::min<size_t>(conf.count, 10000);
+    {
+	bench_result warm;
+	measure_echo(port, 1, conf.size, warm);
+    }
+    auto rss_end = rss_kb();
+
+    measure_echo(port, count, conf.size, r);
+    r.conns = n_idle + 1;
+    if (n_idle > 0) {
+	// scaled from n_idle, and includes both client and server ends.
+	r.rss_kb_per_1k_conns = (rss_end - rss_beg) * 1000 / static_cast<int64_t>(n_idle);
+    }
+    return r;
+}
+
+// latency from publishing one message until all subscribers receive it
+static bench_result bench_fanout(const bench_conf& conf, const std::string& transport)
+{
+    bench_result r{"fanout", transport};
+
+    std::vector<char> payload(conf.size, 'f');
+    bench_msgbuf msg, rsp;
+    std::vector<bench_port> subs;
+    for (size_t i = 0; i < conf.subscribers; i++) {
+	subs.push_back(connect_client(transport));
+	msg.header = {EV_SUB, 0};
+	set_payload(msg, payload);
+	send_or_die(msg, subs.back());
+	recv_or_die(rsp, subs.back());		// wait for subscription
+    }
+    auto pub = connect_client(transport);
+    r.conns = subs.size() + 1;
+
+    r.latency_ns.reserve(conf.rounds);
+    auto beg = c7::monotonic_ns();
+    for (size_t i = 0; i < conf.rounds; i++) {
+	msg.header = {EV_PUB, static_cast<int32_t>(i)};
+	set_payload(msg, payload);
+	auto t0 = c7::monotonic_ns();
+	send_or_die(msg, pub);
+	for (auto& sub: subs) {
+	    recv_or_die(rsp, sub);
+	}
+	r.latency_ns.push_back(c7::monotonic_ns() - t0);
+    }
+    r.n = conf.rounds * subs.size();		// delivered messages
+    r.size = conf.size;
+    set_throughput(r, beg, c7::monotonic_ns());
+    r.finish();
+
+    // [MEMO] subscribers must leave portgroup before next suite, so that their
+    //        ports are removed by on_close on monitor thread.
+    subs.clear();
+    return r;
+}
+
+
+/*----------------------------------------------------------------------------
+                                     main
+----------------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+    bench_conf conf;
+    bench_args args{conf};
+    if (auto res = args.init(); !res) {
+	c7error(res);
+    }
+    if (auto res = args.parse(argv + 1); !res) {
+	c7error(res);
+    } else if (*res.value() != nullptr) {
+	c7error("unexpected parameter: %{}", *res.value());
+    }
+    if (conf.suites.empty()) {
+	conf.suites = all_suites;
+    }
+    if (conf.transports.empty()) {
+	conf.transports = all_transports;
+    }
+
+    start_server();
+
+    for (auto& suite: conf.suites) {
+	for (auto& transport: conf.transports) {
+	    bench_result r;
+	    if (suite == "echo") {
+		r = bench_echo(conf, transport);
+	    } else if (suite == "pipeline") {
+		r = bench_pipeline(conf, transport);
+	    } else if (suite == "idle") {
+		r = bench_idle(conf, transport);
+	    } else {
+		r = bench_fanout(conf, transport);
+	    }
+	    r.print(conf.json);
+	    std::fflush(stdout);
+	    ::usleep(100 * 1000);	// let server release connections of this suite
+	}
+    }
+
+    ::unlink(unix_path.c_str());
+
+    // The event loop thread never returns, so exit without destructing
+    // static objects which are used by it.
+    std::fflush(stdout);
+    ::_exit(0);
+}
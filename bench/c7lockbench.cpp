@@ -0,0 +1,240 @@
+/*
+ * c7lockbench.cpp
+ *
+ * Copyright (c) 2025 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ */
+
+
+#include <c7app.hpp>
+#include <c7args.hpp>
+#include <c7defer.hpp>
+#include <c7nseq/flat.hpp>
+#include <c7nseq/string.hpp>
+#include <c7nseq/transform.hpp>
+#include <c7thread/condvar.hpp>
+#include <c7thread/fastlock.hpp>
+#include <c7thread/mutex.hpp>
+#include <c7thread/spinlock.hpp>
+#include <c7utils/time.hpp>
+#include <_c7version.hpp>
+#include <algorithm>
+#include <cstdio>
+
+
+using c7::p_;
+
+
+// Cost of one uncontended lock/unlock through each guard:
+//
+// - defer: c7::defer holding the unlock closure (formerly returned by lock())
+// - guard: c7::thread::lock_guard returned by lock()
+//
+// and the cost of c7::defer and c7::scope_guard for a plain closure.
+
+
+/*----------------------------------------------------------------------------
+                                configuration
+----------------------------------------------------------------------------*/
+
+struct bench_conf {
+    size_t count = 10000000;		// lock/unlock per case
+    size_t repeat = 5;			// best of repeat
+    bool json = false;
+};
+
+
+class bench_args: public c7::args::parser {
+public:
+    bench_args(bench_conf& conf): conf_(conf) {}
+    c7::result<> init() override;
+
+private:
+    bench_conf& conf_;
+
+    callback_t opt_count;
+    callback_t opt_repeat;
+    callback_t opt_json;
+    callback_t opt_help;
+};
+
+c7::result<>
+bench_args::init()
+{
+    c7::result<> res;
+    {
+	opt_desc d;
+	d.long_name	= "count";
+	d.short_name	= "n";
+	d.type		= opt_desc::prm_type::UINT;
+	d.opt_descrip	= "number of lock/unlock per case";
+	d.prm_name	= "COUNT";
+	d.prm_descrip	= "count (default: 10000000)";
+	d.prmc_min	= 1;
+	d.prmc_max	= 1;
+	res << add_opt(d, &bench_args::opt_count);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "repeat";
+	d.short_name	= "r";
+	d.type		= opt_desc::prm_type::UINT;
+	d.opt_descrip	= "measure each case REPEAT times and take the best";
+	d.prm_name	= "REPEAT";
+	d.prm_descrip	= "repeat (default: 5)";
+	d.prmc_min	= 1;
+	d.prmc_max	= 1;
+	res << add_opt(d, &bench_args::opt_repeat);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "json";
+	d.short_name	= "j";
+	d.opt_descrip	= "print results as JSON lines";
+	res << add_opt(d, &bench_args::opt_json);
+    }
+    {
+	opt_desc d;
+	d.long_name	= "help";
+	d.short_name	= "h";
+	d.opt_descrip	= "show this usage";
+	res << add_opt(d, &bench_args::opt_help);
+    }
+    return res;
+}
+
+c7::result<>
+bench_args::opt_count(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    conf_.count = std::max<size_t>(vals[0].u, 1);
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_repeat(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    conf_.repeat = std::max<size_t>(vals[0].u, 1);
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_json(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    conf_.json = true;
+    return c7result_ok();
+}
+
+c7::result<>
+bench_args::opt_help(const opt_desc& desc, const std::vector<opt_value>& vals)
+{
+    c7::strvec usage;
+    usage.push_back(c7::format("Usage: %{} [option ...]\n\n option:\n", c7::app::progname));
+    append_usage(usage, 2, 32);
+    auto s = usage
+	| c7::nseq::transform([](auto& s){ return s+"\n"; })
+	| c7::nseq::flat<1>()
+	| c7::nseq::to_string();
+    c7::drop = write(2, s.c_str(), s.size());
+    std::exit(0);
+    return c7result_ok();
+}
+
+
+/*----------------------------------------------------------------------------
+                                    cases
+----------------------------------------------------------------------------*/
+
+static volatile size_t shared_counter;
+
+template <typename F>
+static double measure(const bench_conf& conf, F body)
+{
+    int64_t best_ns = -1;
+    for (size_t r = 0; r < conf.repeat; r++) {
+	auto beg = c7::monotonic_ns();
+	for (size_t i = 0; i < conf.count; i++) {
+	    body();
+	}
+	auto ns = c7::monotonic_ns() - beg;
+	if (best_ns < 0 || ns < best_ns) {
+	    best_ns = ns;
+	}
+    }
+    return static_cast<double>(best_ns) / conf.count;
+}
+
+
+static void print(const bench_conf& conf, const char *target, double defer_ns, double guard_ns)
+{
+    if (conf.json) {
+	p_("{\"version\":\"%{}.%{}.%{}\",\"target\":\"%{}\",\"n\":%{},"
+	   "\"defer_ns\":%{.2f},\"guard_ns\":%{.2f}}",
+	   C7XX_VERSION_MAJOR, C7XX_VERSION_MINOR, C7XX_VERSION_PATCH,
+	   target, conf.count, defer_ns, guard_ns);
+    } else {
+	p_("%{<16}  defer:%{6.2f} ns, guard:%{6.2f} ns, saved:%{6.2f} ns/op",
+	   target, defer_ns, guard_ns, defer_ns - guard_ns);
+    }
+    std::fflush(stdout);
+}
+
+
+template <typename Lock>
+static void bench_lock(const bench_conf& conf, const char *target)
+{
+    Lock lock;
+    auto defer_ns = measure(conf, [&lock](){
+	    lock._lock();
+	    c7::defer unlock([&lock](){ lock.unlock(); });
+	    shared_counter = shared_counter + 1;
+	});
+    auto guard_ns = measure(conf, [&lock](){
+	    auto unlock = lock.lock();
+	    shared_counter = shared_counter + 1;
+	});
+    print(conf, target, defer_ns, guard_ns);
+}
+
+
+// closure captures 3 pointers: it exceeds small buffer of std::function.
+static void bench_closure(const bench_conf& conf)
+{
+    size_t a = 1, b = 2, c = 3;
+    auto defer_ns = measure(conf, [&a, &b, &c](){
+	    c7::defer on_exit([&a, &b, &c](){ shared_counter = shared_counter + a + b + c; });
+	});
+    auto guard_ns = measure(conf, [&a, &b, &c](){
+	    c7::scope_guard on_exit([&a, &b, &c](){ shared_counter = shared_counter + a + b + c; });
+	});
+    print(conf, "closure", defer_ns, guard_ns);
+}
+
+
+/*----------------------------------------------------------------------------
+                                    main
+----------------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+    bench_conf conf;
+    bench_args args{conf};
+    if (auto res = args.init(); !res) {
+	c7error(res);
+    }
+    if (auto res = args.parse(argv + 1); !res) {
+	c7error(res);
+    } else if (*res.value() != nullptr) {
+	c7error("unexpected parameter: %{}", *res.value());
+    }
+
+    bench_lock<c7::thread::mutex>(conf, "mutex");
+    bench_lock<c7::thread::spinlock>(conf, "spinlock");
+    bench_lock<c7::thread::condvar>(conf, "condvar");
+    bench_lock<c7::thread::ttas_spinlock>(conf, "ttas_spinlock");
+    bench_lock<c7::thread::adaptive_mutex>(conf, "adaptive_mutex");
+    bench_closure(conf);
+
+    return 0;
+}
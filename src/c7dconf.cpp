@@ -22,6 +22,9 @@ static std::vector<dconf_def> sys_defv{
     C7_DCONF_DEF_I3(C7_DCONF_rsv_91, MLOG_former, "--- (moved to MLOG_MAIN) ---"),
     C7_DCONF_DEF_I3(C7_DCONF_MLOG, MLOG_MAIN, "mlog level (default:4)"),
     C7_DCONF_DEF_I3(C7_DCONF_MLOG_LIBC7, MLOG_LIBC7, "mlog level: libc7++"),
+    C7_DCONF_DEF_I3(C7_DCONF_EVENT_STATS, EVENT_STATS, "event monitor stats (0:off, 1:on)"),
+    C7_DCONF_DEF_I3(C7_DCONF_EVENT_STATS_DUMP, EVENT_STATS_DUMP, "event monitor stats dump interval [s] (0:none)"),
+    C7_DCONF_DEF_I3(C7_DCONF_EVENT_SLOW_US, EVENT_SLOW_US, "event monitor slow handler threshold [us] (0:10000)"),
 };
 
 
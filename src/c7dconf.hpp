@@ -32,9 +32,9 @@
 enum c7_dconf_reserve_t {
     C7_DCONF_rsv_90 = C7_DCONF_USER_INDEX_LIM,
     C7_DCONF_rsv_91,		// former MLOG level
-    C7_DCONF_rsv_92,
-    C7_DCONF_rsv_93,
-    C7_DCONF_rsv_94,
+    C7_DCONF_EVENT_STATS,	// c7::event::monitor instrumentation (0:off)
+    C7_DCONF_EVENT_STATS_DUMP,	// interval seconds to dump monitor stats into mlog (0:none)
+    C7_DCONF_EVENT_SLOW_US,	// threshold of slow handler in usec (0:default)
     // all 32 indexes between C7_DCONF_MLOG and C7_DCONF_MLOG_LIBC7 are for mlog
     C7_DCONF_MLOG = C7_DCONF_MLOG_BASE,
     C7_DCONF_MLOG_1,
@@ -15,6 +15,7 @@
 
 
 #include <functional>
+#include <utility>
 
 
 namespace c7 {
@@ -78,7 +79,7 @@ public:
     }
 
     void operator()() {
-	auto f = func_;
+	auto f = std::move(func_);
 	func_ = nullptr;
 	if (f) {
 	    f();
@@ -105,6 +106,54 @@ public:
 };
 
 
+// scope guard without type erasure
+// --------------------------------
+//
+// - Same usage as c7::defer except that only one function is held: F is
+//   called by destructor or by operator()() at most once.
+// - F is stored by value, so no allocation and no std::function.
+//
+//   [Example]
+//
+//      auto closer = c7::scope_guard([fd](){ ::close(fd); });
+
+template <typename F>
+class [[nodiscard]] scope_guard {
+private:
+    F func_;
+    bool active_;
+
+public:
+    scope_guard(const scope_guard&) = delete;
+    scope_guard& operator=(const scope_guard&) = delete;
+    scope_guard& operator=(scope_guard&&) = delete;
+
+    explicit scope_guard(F f): func_(std::move(f)), active_(true) {}
+
+    scope_guard(scope_guard&& o): func_(std::move(o.func_)), active_(std::exchange(o.active_, false)) {}
+
+    void operator()() {
+	if (std::exchange(active_, false)) {
+	    func_();
+	}
+    }
+
+    explicit operator bool() const {
+	return active_;
+    }
+
+    void cancel() {
+	active_ = false;
+    }
+
+    ~scope_guard() {
+	if (active_) {
+	    func_();
+	}
+    }
+};
+
+
 } // namespace c7
 
 
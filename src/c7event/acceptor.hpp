@@ -18,6 +18,7 @@
 #include <c7event/monitor.hpp>
 #include <c7event/receiver.hpp>
 #include <c7event/service.hpp>
+#include <vector>
 
 
 namespace c7::event {
@@ -60,10 +61,14 @@ public:
     void on_manage(monitor& mon, int prvfd) override;
     void on_event(monitor& mon, int prvfd, uint32_t events) override;
 
+    // maximum number of connections accepted by one event (default: 64)
+    void set_accept_batch(int n) { accept_batch_ = std::max(n, 1); }
+
 private:
     Port port_;
     service_make svc_factory_;
     provider_hint hint_;
+    int accept_batch_ = 64;
 
     acceptor(Port&& port, service_make svc_factory, provider_hint hint);
 };
@@ -142,6 +147,68 @@ result<> manage_acceptor(monitor& mon,
 }
 
 
+// SO_REUSEPORT sharding
+// ---------------------
+//
+// One listening socket bound to same addr with SO_REUSEPORT is created for each
+// monitor, and acceptor of each socket is managed by the monitor. Kernel distributes
+// incoming connections among these sockets, so that accepted connections are
+// handled by all monitors (threads).
+//
+// - TCP only: SO_REUSEPORT is not supported for AF_UNIX (EINVAL is returned).
+// - All sockets are created, bound and listened before any acceptor is managed,
+//   and acceptors already managed are unmanaged if manage() fails. So nothing is
+//   left listening on error.
+
+template <typename ServiceFactory,
+	  typename Service = typename std::invoke_result_t<ServiceFactory>::element_type>
+result<> manage_acceptor_shards(const std::vector<monitor*>& mons,
+				const sockaddr_gen& addr,
+				ServiceFactory&& svc_factory,
+				provider_hint hint = nullptr,
+				int backlog = SOMAXCONN)
+{
+    using port_type = typename Service::port_type;
+
+    if (!addr.is_ipv4()) {
+	return c7result_err(EINVAL, "manage_acceptor_shards: TCP (IPv4) address is required");
+    }
+
+    std::vector<c7::socket> socks;
+    for (size_t i = 0; i < mons.size(); i++) {
+	auto res = c7::socket::tcp();
+	if (!res) {
+	    return c7result_err(std::move(res));
+	}
+	auto sock = std::move(res.value());
+	if (auto res = sock.set_reuseport(true); !res) {
+	    return res;
+	}
+	if (auto res = sock.bind(addr); !res) {
+	    return res;
+	}
+	if (auto res = sock.listen(backlog); !res) {
+	    return res;
+	}
+	socks.push_back(std::move(sock));
+    }
+
+    std::vector<std::pair<monitor*, int>> managed;
+    for (size_t i = 0; i < mons.size(); i++) {
+	auto acc = make_acceptor(port_type(std::move(socks[i])), svc_factory, hint);
+	int prvfd = acc->fd();
+	if (auto res = mons[i]->manage(std::move(acc)); !res) {
+	    for (auto [mon, fd]: managed) {
+		(void)mon->unmanage(fd);
+	    }
+	    return res;
+	}
+	managed.emplace_back(mons[i], prvfd);
+    }
+    return c7result_ok();
+}
+
+
 } // namespace c7::event
 
 
@@ -42,18 +42,28 @@ template <typename Msgbuf, typename Port>
 void acceptor<Msgbuf, Port>::on_manage(monitor& mon, int prvfd)
 {
     port_.add_on_close([&mon, prvfd](){ mon.unmanage(prvfd); });
+    // listening socket must be non-blocking to drain backlog in on_event.
+    if (auto res = port_.set_nonblocking(true); !res) {
+	on_error(port_, res);
+    }
 }
 
 
 template <typename Msgbuf, typename Port>
 void acceptor<Msgbuf, Port>::on_event(monitor& mon, int, uint32_t)
 {
-    if (auto res = port_.accept(); !res) {
-	on_error(port_, res);
-    } else {
-	auto port = std::move(res.value());
-	auto prv = make_receiver(std::move(port), svc_factory_(), hint_);
-	mon.manage(std::move(prv));
+    // drain backlog up to accept_batch_ connections per event.
+    for (int i = 0; i < accept_batch_; i++) {
+	if (auto res = port_.accept(); !res) {
+	    if (!res.has_what(EAGAIN) && !res.has_what(EWOULDBLOCK)) {
+		on_error(port_, res);
+	    }
+	    break;
+	} else {
+	    auto port = std::move(res.value());
+	    auto prv = make_receiver(std::move(port), svc_factory_(), hint_);
+	    mon.manage(std::move(prv));
+	}
     }
 }
 
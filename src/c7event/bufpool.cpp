@@ -0,0 +1,189 @@
+/*
+ * c7event/bufpool.cpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ */
+
+
+#include <c7event/bufpool.hpp>
+#include <c7format.hpp>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace c7::event {
+
+
+/*----------------------------------------------------------------------------
+                                  buffer_pool
+----------------------------------------------------------------------------*/
+
+// [MEMO] pool_finished is trivially destructible, so it can be referred even if
+//        thread local pool has been destructed at thread exit.
+static thread_local bool pool_finished = false;
+
+namespace {
+struct thread_pool: public buffer_pool {
+    ~thread_pool() {
+	pool_finished = true;
+    }
+};
+}
+
+static thread_local thread_pool this_thread_pool;
+
+
+buffer_pool::~buffer_pool()
+{
+    release();
+}
+
+buffer_pool&
+buffer_pool::this_thread()
+{
+    return this_thread_pool;
+}
+
+int
+buffer_pool::class_of(size_t cap)
+{
+    for (int i = 0; i < n_class; i++) {
+	if ((min_class_size << i) == cap) {
+	    return i;
+	}
+    }
+    return -1;
+}
+
+void *
+buffer_pool::get(size_t req, size_t& cap)
+{
+    stats_.n_get++;
+
+    int k = 0;
+    while (k < n_class && (min_class_size << k) < req) {
+	k++;
+    }
+    if (k < n_class) {
+	cap = min_class_size << k;
+	if (auto item = free_[k]; item != nullptr) {
+	    free_[k] = item->next;
+	    n_free_[k]--;
+	    stats_.n_hit++;
+	    stats_.cached_bytes -= cap;
+	    stats_.lent_bytes += cap;
+	    stats_.lent_hwm = std::max(stats_.lent_hwm, stats_.lent_bytes);
+	    return item;
+	}
+    } else {
+	cap = c7_align(req, min_class_size);
+    }
+
+    void *addr = std::malloc(cap);
+    if (addr == nullptr) {
+	cap = 0;
+	return nullptr;
+    }
+    stats_.n_alloc++;
+    stats_.lent_bytes += cap;
+    stats_.lent_hwm = std::max(stats_.lent_hwm, stats_.lent_bytes);
+    return addr;
+}
+
+void
+buffer_pool::back(void *addr, size_t cap)
+{
+    if (addr == nullptr) {
+	return;
+    }
+    // buffer may be obtained by other thread.
+    stats_.lent_bytes -= std::min(stats_.lent_bytes, cap);
+
+    if (auto k = class_of(cap); k != -1 && n_free_[k] < cache_limit_) {
+	auto item = static_cast<free_item*>(addr);
+	item->next = free_[k];
+	free_[k] = item;
+	n_free_[k]++;
+	stats_.cached_bytes += cap;
+	stats_.cached_hwm = std::max(stats_.cached_hwm, stats_.cached_bytes);
+    } else {
+	std::free(addr);
+	stats_.n_free++;
+    }
+}
+
+void
+buffer_pool::release()
+{
+    for (int k = 0; k < n_class; k++) {
+	while (auto item = free_[k]) {
+	    free_[k] = item->next;
+	    std::free(item);
+	    stats_.n_free++;
+	}
+	n_free_[k] = 0;
+    }
+    stats_.cached_bytes = 0;
+}
+
+void
+buffer_pool::stats_t::print(std::ostream& out, const std::string&) const
+{
+    c7::format(out,
+	       "get:%{}, hit:%{}, alloc:%{}, free:%{}, "
+	       "lent:%{}(hwm:%{}), cached:%{}(hwm:%{})",
+	       n_get, n_hit, n_alloc, n_free,
+	       lent_bytes, lent_hwm, cached_bytes, cached_hwm);
+}
+
+
+/*----------------------------------------------------------------------------
+                                pooled_storage
+----------------------------------------------------------------------------*/
+
+result<>
+pooled_storage::reserve(size_t req)
+{
+    if (req <= size_) {
+	return c7result_ok();
+    }
+
+    size_t cap;
+    void *new_addr;
+    if (pool_finished) {
+	cap = c7_align(req, buffer_pool::min_class_size);
+	new_addr = std::malloc(cap);
+    } else {
+	new_addr = buffer_pool::this_thread().get(req, cap);
+    }
+    if (new_addr == nullptr) {
+	return c7result_err(errno, "cannot allocate memory");
+    }
+    if (size_ > 0) {
+	std::memcpy(new_addr, addr_, size_);
+    }
+    reset();
+    addr_ = new_addr;
+    size_ = cap;
+    return c7result_ok();
+}
+
+void
+pooled_storage::reset()
+{
+    if (addr_ != nullptr) {
+	if (pool_finished) {
+	    std::free(addr_);
+	} else {
+	    buffer_pool::this_thread().back(addr_, size_);
+	}
+	addr_ = nullptr;
+	size_ = 0;
+    }
+}
+
+
+} // namespace c7::event
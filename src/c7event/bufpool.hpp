@@ -0,0 +1,126 @@
+/*
+ * c7event/bufpool.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google document:
+ * https://docs.google.com/document/d/1_2Pj_MDBpX0PwGYouK46sXM1qWyUOi8iUv1zynuXqA0/edit?usp=sharing
+ */
+#ifndef C7_EVENT_BUFPOOL_HPP_LOADED_
+#define C7_EVENT_BUFPOOL_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7result.hpp>
+
+
+namespace c7::event {
+
+
+// per-thread buffer pool for message buffers
+// ------------------------------------------
+//
+// - buffers are classified by capacity: min_class_size << i (0 <= i < n_class).
+// - buffers larger than the largest class are not pooled (malloc/free directly).
+// - each thread has its own pool (no lock). A buffer is returned to the pool of
+//   the thread which returns it.
+
+class buffer_pool {
+public:
+    static constexpr size_t min_class_size = 8192;
+    static constexpr int n_class = 12;		// 8KiB ... 16MiB
+
+    struct stats_t {
+	size_t n_get;		// # of get
+	size_t n_hit;		// # of get satisfied by cached buffer
+	size_t n_alloc;		// # of heap allocation
+	size_t n_free;		// # of heap deallocation
+	size_t lent_bytes;	// bytes of buffers in use
+	size_t lent_hwm;	// high-water-mark of lent_bytes
+	size_t cached_bytes;	// bytes of buffers in pool
+	size_t cached_hwm;	// high-water-mark of cached_bytes
+
+	void print(std::ostream& out, const std::string& spec) const;
+    };
+
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+
+    buffer_pool() = default;
+    ~buffer_pool();
+
+    static buffer_pool& this_thread();
+
+    // get buffer whose capacity is not less than req, and capacity is stored to cap.
+    void *get(size_t req, size_t& cap);
+
+    // return buffer obtained by get() of any thread.
+    void back(void *addr, size_t cap);
+
+    // maximum number of cached buffers for each class (default: 32)
+    void set_cache_limit(size_t n_per_class) { cache_limit_ = n_per_class; }
+
+    // free all cached buffers
+    void release();
+
+    const stats_t& stats() const { return stats_; }
+
+private:
+    struct free_item {
+	free_item *next;
+    };
+
+    free_item *free_[n_class] = {};
+    size_t n_free_[n_class] = {};
+    size_t cache_limit_ = 32;
+    stats_t stats_ = {};
+
+    static int class_of(size_t cap);
+};
+
+
+// storage whose memory is supplied by buffer_pool::this_thread()
+// --------------------------------------------------------------
+
+class pooled_storage {
+public:
+    pooled_storage() = default;
+    ~pooled_storage() { reset(); }
+    pooled_storage(const pooled_storage&) = delete;
+    pooled_storage(pooled_storage&& o): addr_(o.addr_), size_(o.size_) {
+	o.addr_ = nullptr;
+	o.size_ = 0;
+    }
+    pooled_storage& operator=(const pooled_storage&) = delete;
+    pooled_storage& operator=(pooled_storage&& o) {
+	if (this != &o) {
+	    reset();
+	    addr_ = o.addr_;
+	    size_ = o.size_;
+	    o.addr_ = nullptr;
+	    o.size_ = 0;
+	}
+	return *this;
+    }
+
+    result<> reserve(size_t req);
+    void reset();			// give back buffer to pool
+    size_t size() const { return size_; }
+    void *addr() { return addr_; }
+    const void *addr() const { return addr_; }
+    template <typename T> operator T*() { return static_cast<T*>(addr_); }
+    template <typename T> operator const T*() const { return static_cast<T*>(addr_); }
+
+private:
+    void *addr_ = nullptr;
+    size_t size_ = 0;
+};
+
+
+} // namespace c7::event
+
+
+#endif // c7event/bufpool.hpp
@@ -0,0 +1,222 @@
+/*
+ * c7event/connpool.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google document:
+ * https://docs.google.com/document/d/1_2Pj_MDBpX0PwGYouK46sXM1qWyUOi8iUv1zynuXqA0/edit?usp=sharing
+ */
+#ifndef C7_EVENT_CONNPOOL_HPP_LOADED_
+#define C7_EVENT_CONNPOOL_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7event/connector.hpp>
+#include <c7event/timer.hpp>
+#include <c7thread/condvar.hpp>
+#include <c7utils/time.hpp>
+#include <atomic>
+#include <unordered_map>
+
+
+namespace c7::event {
+
+
+// correlation id of message
+// -------------------------
+// These are only primary template declarations without definition. The user of
+// connection_pool must define them for Msgbuf (e.g. a member of the header of
+// multipart_msgbuf), and the peer must echo the id in its response.
+template <typename Msgbuf>
+uint64_t get_correlation_id(const Msgbuf& msgbuf);
+
+template <typename Msgbuf>
+void set_correlation_id(Msgbuf& msgbuf, uint64_t id);
+
+
+struct connection_pool_config {
+    int n_connection = 2;				// warm connections
+    c7::usec_t request_timeout_us = 10 * C7_TIME_S_us;	// 0: no timeout
+    c7::usec_t health_interval_us = 1 * C7_TIME_S_us;	// timeout check and ping
+    c7::usec_t reconnect_min_us = 100 * 1000;		// backoff after disconnection
+    c7::usec_t reconnect_max_us = 30 * C7_TIME_S_us;
+};
+
+
+// response handle of connection_pool::call
+// ----------------------------------------
+//
+// - get() and wait() must not be called on the monitor thread of the pool,
+//   because the response is completed on that thread.
+
+template <typename Msgbuf>
+class connection_reply {
+public:
+    connection_reply() = default;
+
+    bool ready() {
+	auto unlock = state_->cv.lock();
+	return state_->done;
+    }
+
+    // return false if timeout (timeout_us < 0: wait forever)
+    bool wait(c7::usec_t timeout_us = -1) {
+	auto unlock = state_->cv.lock();
+	return state_->cv.wait_for(c7::mktimespec(timeout_us),
+				   [this](){ return state_->done; });
+    }
+
+    // wait and take the response
+    result<Msgbuf> get() {
+	(void)wait();
+	if (!state_->io_res) {
+	    return c7result_err(std::move(state_->io_res.get_result()));
+	}
+	return c7result_ok(std::move(state_->msg));
+    }
+
+private:
+    template <typename, typename>
+    friend class connection_pool;
+
+    struct state {
+	c7::thread::condvar cv;
+	bool done = false;
+	io_result io_res;
+	Msgbuf msg;
+    };
+
+    std::shared_ptr<state> state_ = std::make_shared<state>();
+
+    void complete(io_result& io_res, Msgbuf& msg) {
+	auto unlock = state_->cv.lock();
+	state_->io_res = std::move(io_res);
+	if (state_->io_res) {
+	    state_->msg = std::move(msg);
+	}
+	state_->done = true;
+	state_->cv.notify_all();
+    }
+};
+
+
+// pool of outbound connections
+// ----------------------------
+//
+// - Keep n_connection connections to one endpoint by connector. Disconnected
+//   connection is reconnected on timer of monitor with exponential backoff, so
+//   that request never waits connection establishment.
+// - call() set new correlation id to request, send it on the connection which has
+//   least outstanding requests, and complete it by callback (or reply handle) when
+//   the response which has same correlation id is received. Requests are
+//   pipelined on each connection.
+// - Pending requests fail with ETIMEDOUT after request_timeout_us, with
+//   ECONNRESET when the connection is lost, or with ECANCELED by shutdown()
+//   (the destructor calls it).
+// - If set_ping() is used, a ping request is sent on every idle connection on each
+//   health_interval_us, and the connection is shut down if no response is received
+//   until next interval.
+// - Port must be blocking after connected (connector does it), because call()
+//   writes request on the caller thread.
+// - If sending a request fails, the connection is shut down and reconnected as
+//   when it is lost, and it is not selected until then.
+//
+//   [Example]
+//
+//      auto pool = connection_pool<my_msgbuf>::make(mon, addr);
+//      pool->start();
+//      pool->call(req, [](io_result& res, my_msgbuf& rsp) { ... });
+//      auto rsp = pool->call(req).value().get();	// not on monitor thread
+
+template <typename Msgbuf, typename Port = socket_port>
+class connection_pool: public std::enable_shared_from_this<connection_pool<Msgbuf, Port>> {
+public:
+    using callback_t = std::function<void(io_result&, Msgbuf&)>;
+    using reply_type = connection_reply<Msgbuf>;
+
+    struct stats_t {
+	uint64_t n_call = 0;
+	uint64_t n_reply = 0;
+	uint64_t n_timeout = 0;
+	uint64_t n_reset = 0;
+	uint64_t n_unmatched = 0;
+	uint64_t n_connect = 0;
+	uint64_t n_disconnect = 0;
+
+	void print(std::ostream& out, const std::string&) const;
+    };
+
+    connection_pool(const connection_pool&) = delete;
+    connection_pool& operator=(const connection_pool&) = delete;
+    ~connection_pool();			// shutdown() is called
+
+    static std::shared_ptr<connection_pool>
+    make(monitor& mon, const sockaddr_gen& addr,
+	 const connection_pool_config& config = connection_pool_config{});
+
+    // setup before start()
+    void set_ping(std::function<void(Msgbuf&)> make_ping) {
+	make_ping_ = std::move(make_ping);
+    }
+
+    result<> start();
+    void shutdown();
+
+    result<> call(Msgbuf& req, callback_t callback);
+    result<reply_type> call(Msgbuf& req);
+
+    size_t n_connected();
+    stats_t stats();
+
+private:
+    class pool_service;
+
+    struct pending {
+	c7::usec_t deadline;		// 0: no timeout
+	callback_t callback;
+	bool ping;
+    };
+
+    struct slot {
+	c7::thread::mutex send_lock;	// send_lock -> lock_
+	Port *port = nullptr;		// valid while attached
+	int prvfd = C7_SYSERR;
+	std::unordered_map<uint64_t, pending> pendings;
+	c7::usec_t backoff_us = 0;
+	bool ping_sent = false;
+	bool broken = false;		// send failed: not selected until reattached
+    };
+
+    monitor& mon_;
+    sockaddr_gen addr_;
+    connection_pool_config config_;
+    std::function<void(Msgbuf&)> make_ping_;
+    std::shared_ptr<pool_service> svc_;
+    std::vector<std::unique_ptr<slot>> slots_;
+    c7::thread::mutex lock_;
+    std::atomic<uint64_t> next_id_ {0};
+    size_t rr_ = 0;
+    int health_fd_ = C7_SYSERR;
+    bool closing_ = false;
+    stats_t stats_;
+
+    connection_pool(monitor& mon, const sockaddr_gen& addr, const connection_pool_config& config);
+
+    result<> connect_slot(size_t index);
+    void reconnect_later(size_t index, c7::usec_t delay_us);
+    result<> send_request(Msgbuf& req, callback_t&& callback, slot *ping_slot = nullptr);
+    void on_attached(size_t index, Port& port);
+    void on_detached(size_t index);
+    void on_response(Msgbuf& msg);
+    void on_health_check();
+    static void fail(std::vector<callback_t>& callbacks, int err, const char *what);
+};
+
+
+} // namespace c7::event
+
+
+#endif // c7event/connpool.hpp
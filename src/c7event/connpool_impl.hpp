@@ -0,0 +1,461 @@
+/*
+ * c7event/connpool_impl.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google document:
+ * https://docs.google.com/document/d/1_2Pj_MDBpX0PwGYouK46sXM1qWyUOi8iUv1zynuXqA0/edit?usp=sharing
+ */
+#ifndef C7_EVENT_CONNPOOL_IMPL_HPP_LOADED_
+#define C7_EVENT_CONNPOOL_IMPL_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7event/connpool.hpp>
+#include <c7event/connector_impl.hpp>
+#include <c7format.hpp>
+#include <sys/socket.h>
+
+
+namespace c7::event {
+
+
+// service shared by all connections of pool (hint is index of slot)
+
+
+template <typename Msgbuf, typename Port>
+class connection_pool<Msgbuf, Port>::pool_service: public service_interface<Msgbuf, Port> {
+public:
+    using base_type = service_interface<Msgbuf, Port>;
+    using typename base_type::attach_id;
+    using typename base_type::detach_id;
+
+    explicit pool_service(const std::shared_ptr<connection_pool>& pool): pool_(pool) {}
+
+    attach_id on_attached(monitor& mon, Port& port, provider_hint hint) override {
+	auto id = base_type::on_attached(mon, port, hint);
+	if (auto pool = pool_.lock(); pool) {
+	    pool->on_attached(index_of(hint), port);
+	} else {
+	    port.close();
+	}
+	return id;
+    }
+
+    detach_id on_detached(monitor& mon, Port& port, provider_hint hint) override {
+	auto id = base_type::on_detached(mon, port, hint);
+	if (auto pool = pool_.lock(); pool) {
+	    pool->on_detached(index_of(hint));
+	}
+	return id;
+    }
+
+    void on_message(monitor&, Port&, Msgbuf& msg) override {
+	if (auto pool = pool_.lock(); pool) {
+	    pool->on_response(msg);
+	}
+    }
+
+private:
+    std::weak_ptr<connection_pool> pool_;
+
+    static size_t index_of(const provider_hint& hint) {
+	return std::get<1>(static_cast<const std::variant<void*, uint64_t>&>(hint));
+    }
+};
+
+
+// implementation of connection_pool
+
+
+template <typename Msgbuf, typename Port>
+connection_pool<Msgbuf, Port>::connection_pool(monitor& mon, const sockaddr_gen& addr,
+					       const connection_pool_config& config):
+    mon_(mon), addr_(addr), config_(config)
+{
+    config_.n_connection = std::max(config_.n_connection, 1);
+    for (int i = 0; i < config_.n_connection; i++) {
+	slots_.push_back(std::make_unique<slot>());
+	slots_.back()->backoff_us = config_.reconnect_min_us;
+    }
+}
+
+
+template <typename Msgbuf, typename Port>
+connection_pool<Msgbuf, Port>::~connection_pool()
+{
+    shutdown();
+}
+
+
+template <typename Msgbuf, typename Port>
+std::shared_ptr<connection_pool<Msgbuf, Port>>
+connection_pool<Msgbuf, Port>::make(monitor& mon, const sockaddr_gen& addr,
+				    const connection_pool_config& config)
+{
+    auto pool = std::shared_ptr<connection_pool>(new connection_pool(mon, addr, config));
+    pool->svc_ = std::make_shared<pool_service>(pool);
+    return pool;
+}
+
+
+template <typename Msgbuf, typename Port>
+result<> connection_pool<Msgbuf, Port>::start()
+{
+    for (size_t i = 0; i < slots_.size(); i++) {
+	if (auto res = connect_slot(i); !res) {
+	    return res;
+	}
+    }
+    std::weak_ptr<connection_pool> wp = this->shared_from_this();
+    auto res = timer_start(mon_, config_.health_interval_us, config_.health_interval_us,
+			   [wp](auto, auto) {
+			       if (auto pool = wp.lock(); pool) {
+				   pool->on_health_check();
+			       }
+			   });
+    if (!res) {
+	return res.as_error();
+    }
+    health_fd_ = res.value();
+    return c7result_ok();
+}
+
+
+template <typename Msgbuf, typename Port>
+void connection_pool<Msgbuf, Port>::shutdown()
+{
+    std::vector<int> prvfds;
+    std::vector<callback_t> callbacks;
+    auto unlock = lock_.lock();
+    closing_ = true;
+    for (auto& sp: slots_) {
+	if (sp->port != nullptr) {
+	    prvfds.push_back(sp->prvfd);
+	}
+	// [MEMO] Pending requests fail here, not in on_detached(), because the
+	//        service cannot reach the pool while it is being destroyed.
+	for (auto& [_, pd]: sp->pendings) {
+	    if (!pd.ping) {
+		callbacks.push_back(std::move(pd.callback));
+	    }
+	}
+	sp->pendings.clear();
+    }
+    auto health_fd = health_fd_;
+    health_fd_ = C7_SYSERR;
+    unlock();
+
+    fail(callbacks, ECANCELED, "shutdown");
+
+    if (health_fd != C7_SYSERR) {
+	mon_.unmanage(health_fd);
+    }
+    for (auto prvfd: prvfds) {
+	mon_.unmanage(prvfd);
+    }
+}
+
+
+template <typename Msgbuf, typename Port>
+result<> connection_pool<Msgbuf, Port>::connect_slot(size_t index)
+{
+    return mon_.manage(make_connector(addr_, svc_, provider_hint(index)));
+}
+
+
+template <typename Msgbuf, typename Port>
+void connection_pool<Msgbuf, Port>::reconnect_later(size_t index, c7::usec_t delay_us)
+{
+    std::weak_ptr<connection_pool> wp = this->shared_from_this();
+    auto res = timer_start(mon_, delay_us, 0,
+			   [wp, index](auto, auto) {
+			       if (auto pool = wp.lock(); pool && !pool->closing_) {
+				   (void)pool->connect_slot(index);
+			       }
+			   });
+    if (!res) {
+	(void)connect_slot(index);
+    }
+}
+
+
+template <typename Msgbuf, typename Port>
+result<> connection_pool<Msgbuf, Port>::call(Msgbuf& req, callback_t callback)
+{
+    return send_request(req, std::move(callback));
+}
+
+
+template <typename Msgbuf, typename Port>
+result<typename connection_pool<Msgbuf, Port>::reply_type>
+connection_pool<Msgbuf, Port>::call(Msgbuf& req)
+{
+    reply_type reply;
+    auto res = send_request(req,
+			    [reply](io_result& io_res, Msgbuf& msg) mutable {
+				reply.complete(io_res, msg);
+			    });
+    if (!res) {
+	return res.as_error();
+    }
+    return c7result_ok(std::move(reply));
+}
+
+
+template <typename Msgbuf, typename Port>
+result<> connection_pool<Msgbuf, Port>::send_request(Msgbuf& req, callback_t&& callback,
+						     slot *ping_slot)
+{
+    auto unlock = lock_.lock();
+    if (closing_) {
+	return c7result_err(ECANCELED, "connection_pool: already shutdown");
+    }
+    bool ping = (ping_slot != nullptr);
+    slot *sel = ping_slot;
+    if (ping) {
+	if (sel->port == nullptr || sel->broken) {
+	    return c7result_err(ENOTCONN, "connection_pool: ping: not connected");
+	}
+	sel->ping_sent = true;
+    } else {
+	// select connection which has least outstanding requests.
+	auto n = slots_.size();
+	for (size_t i = 0; i < n; i++) {
+	    auto sp = slots_[(rr_ + i) % n].get();
+	    if (sp->port != nullptr && !sp->broken &&
+		(sel == nullptr || sp->pendings.size() < sel->pendings.size())) {
+		sel = sp;
+	    }
+	}
+	rr_++;
+	if (sel == nullptr) {
+	    return c7result_err(ENOTCONN, "connection_pool: no connection to %{}", addr_);
+	}
+    }
+    auto id = ++next_id_;
+    c7::usec_t deadline = 0;
+    if (config_.request_timeout_us > 0) {
+	deadline = c7::time_us() + config_.request_timeout_us;
+    }
+    sel->pendings.emplace(id, pending{deadline, std::move(callback), ping});
+    if (!ping) {
+	stats_.n_call++;
+    }
+    unlock();
+
+    set_correlation_id(req, id);
+
+    // [MEMO] If call() return error, callback is never called. Pending request
+    //        may have been completed with error after unlock (e.g. connection
+    //        is lost), and then call() return success.
+    auto send_unlock = sel->send_lock.lock();
+    if (sel->port == nullptr) {
+	return c7result_ok();		// completed with ECONNRESET by on_detached()
+    }
+    if (auto io_res = req.send(*sel->port); !io_res) {
+	// [MEMO] Port is not closed here, because it may be used by the monitor thread
+	//        and on_detached() needs send_lock. Shutdown of socket makes receiver
+	//        close the port, and then on_detached() fails pendings and reconnects.
+	(void)::shutdown(sel->port->fd_number(), SHUT_RDWR);
+	auto unlock = lock_.lock();
+	sel->broken = true;
+	if (sel->pendings.erase(id) != 0) {
+	    if (!ping) {
+		stats_.n_call--;
+	    }
+	    return c7result_err(std::move(io_res.get_result()), "connection_pool: send failed");
+	}
+    }
+    return c7result_ok();
+}
+
+
+template <typename Msgbuf, typename Port>
+void connection_pool<Msgbuf, Port>::on_attached(size_t index, Port& port)
+{
+    auto& sl = *slots_[index];
+    auto send_unlock = sl.send_lock.lock();
+    auto unlock = lock_.lock();
+    if (closing_) {
+	unlock();
+	send_unlock();
+	port.close();
+	return;
+    }
+    sl.port = &port;
+    sl.prvfd = port.fd_number();
+    sl.backoff_us = config_.reconnect_min_us;
+    sl.ping_sent = false;
+    sl.broken = false;
+    stats_.n_connect++;
+}
+
+
+template <typename Msgbuf, typename Port>
+void connection_pool<Msgbuf, Port>::on_detached(size_t index)
+{
+    auto& sl = *slots_[index];
+    auto send_unlock = sl.send_lock.lock();
+    auto unlock = lock_.lock();
+    if (sl.port == nullptr) {
+	return;
+    }
+    sl.port = nullptr;
+    sl.prvfd = C7_SYSERR;
+    std::vector<callback_t> callbacks;
+    for (auto& [_, pd]: sl.pendings) {
+	if (!pd.ping) {
+	    callbacks.push_back(std::move(pd.callback));
+	}
+    }
+    sl.pendings.clear();
+    stats_.n_disconnect++;
+    stats_.n_reset += callbacks.size();
+    auto closing = closing_;
+    auto delay_us = sl.backoff_us;
+    sl.backoff_us = std::min(sl.backoff_us * 2, config_.reconnect_max_us);
+    unlock();
+    send_unlock();
+
+    fail(callbacks, ECONNRESET, "connection is lost");
+    if (!closing) {
+	reconnect_later(index, delay_us);
+    }
+}
+
+
+template <typename Msgbuf, typename Port>
+void connection_pool<Msgbuf, Port>::on_response(Msgbuf& msg)
+{
+    auto id = get_correlation_id(msg);
+    callback_t callback;
+    auto unlock = lock_.lock();
+    for (auto& sp: slots_) {
+	if (auto it = sp->pendings.find(id); it != sp->pendings.end()) {
+	    auto& pd = (*it).second;
+	    if (pd.ping) {
+		sp->ping_sent = false;
+		sp->pendings.erase(it);
+		return;
+	    }
+	    callback = std::move(pd.callback);
+	    sp->pendings.erase(it);
+	    stats_.n_reply++;
+	    break;
+	}
+    }
+    if (!callback) {
+	stats_.n_unmatched++;		// timed out or unknown id
+	return;
+    }
+    unlock();
+
+    auto io_res = io_result::ok();
+    callback(io_res, msg);
+}
+
+
+template <typename Msgbuf, typename Port>
+void connection_pool<Msgbuf, Port>::on_health_check()
+{
+    std::vector<callback_t> expired;
+    std::vector<int> dead;
+    std::vector<size_t> idle;
+
+    auto now = c7::time_us();
+    auto unlock = lock_.lock();
+    for (size_t i = 0; i < slots_.size(); i++) {
+	auto& sl = *slots_[i];
+	for (auto it = sl.pendings.begin(); it != sl.pendings.end();) {
+	    auto& pd = (*it).second;
+	    if (pd.deadline != 0 && pd.deadline <= now && !pd.ping) {
+		expired.push_back(std::move(pd.callback));
+		it = sl.pendings.erase(it);
+	    } else {
+		++it;
+	    }
+	}
+	if (sl.port == nullptr || !make_ping_) {
+	    continue;
+	}
+	if (sl.ping_sent) {
+	    if (!sl.broken) {
+		sl.broken = true;		// no response to previous ping
+		dead.push_back(sl.port->fd_number());
+	    }
+	} else if (sl.pendings.empty()) {
+	    idle.push_back(i);
+	}
+    }
+    stats_.n_timeout += expired.size();
+    unlock();
+
+    fail(expired, ETIMEDOUT, "request timeout");
+
+    // [MEMO] Port is not closed here, because on_detached() needs send_lock which
+    //        may be held by a caller blocked in sending to the dead peer. Shutdown
+    //        of socket unblocks it and makes receiver close the port, as well as
+    //        send_request() does on send failure.
+    for (auto fd: dead) {
+	(void)::shutdown(fd, SHUT_RDWR);
+    }
+
+    for (auto i: idle) {
+	Msgbuf ping;
+	make_ping_(ping);
+	(void)send_request(ping, callback_t{}, slots_[i].get());
+    }
+}
+
+
+template <typename Msgbuf, typename Port>
+void connection_pool<Msgbuf, Port>::fail(std::vector<callback_t>& callbacks, int err, const char *what)
+{
+    for (auto& callback: callbacks) {
+	io_result io_res(io_result::status::ERR, 0, 0,
+			 c7result_err(err, "connection_pool: %{}", what));
+	Msgbuf msg;
+	callback(io_res, msg);
+    }
+}
+
+
+template <typename Msgbuf, typename Port>
+size_t connection_pool<Msgbuf, Port>::n_connected()
+{
+    auto unlock = lock_.lock();
+    size_t n = 0;
+    for (auto& sp: slots_) {
+	n += (sp->port != nullptr);
+    }
+    return n;
+}
+
+
+template <typename Msgbuf, typename Port>
+typename connection_pool<Msgbuf, Port>::stats_t
+connection_pool<Msgbuf, Port>::stats()
+{
+    auto unlock = lock_.lock();
+    return stats_;
+}
+
+
+template <typename Msgbuf, typename Port>
+void connection_pool<Msgbuf, Port>::stats_t::print(std::ostream& out, const std::string&) const
+{
+    c7::format(out,
+	       "call:%{}, reply:%{}, timeout:%{}, reset:%{}, unmatched:%{}, "
+	       "connect:%{}, disconnect:%{}",
+	       n_call, n_reply, n_timeout, n_reset, n_unmatched, n_connect, n_disconnect);
+}
+
+
+} // namespace c7::event
+
+
+#endif // c7event/connpool_impl.hpp
@@ -0,0 +1,127 @@
+/*
+ * c7event/dgram.cpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ */
+
+
+#include <c7event/dgram.hpp>
+#include <c7format.hpp>
+#include <algorithm>
+
+
+namespace c7::event {
+
+
+datagram_receiver::datagram_receiver(c7::socket&& sock,
+				     std::shared_ptr<datagram_service_interface>&& svc,
+				     const config& conf):
+    sock_(std::move(sock)), svc_(std::move(svc)), conf_(conf)
+{
+    // recvmmsg receives at most mmsg_max datagrams, and less means socket is drained.
+    conf_.batch_size = std::clamp(conf_.batch_size, 1, c7::socket::mmsg_max);
+    arena_.resize(conf_.batch_size * conf_.slot_size);
+    dgs_.resize(conf_.batch_size);
+}
+
+
+std::shared_ptr<datagram_receiver>
+datagram_receiver::make(c7::socket&& sock, std::shared_ptr<datagram_service_interface> svc,
+			const config& conf)
+{
+    auto p = new datagram_receiver(std::move(sock), std::move(svc), conf);
+    return std::shared_ptr<datagram_receiver>(p);
+}
+
+
+int
+datagram_receiver::fd()
+{
+    return int(sock_);
+}
+
+
+void
+datagram_receiver::on_manage(monitor& mon, int prvfd)
+{
+    sock_.on_close.push_back([&mon, prvfd](auto&){ mon.unmanage(prvfd); });
+    if (auto res = sock_.set_nonblocking(true); !res) {
+	svc_->on_error(mon, sock_, res);
+    }
+    if (conf_.gro) {
+	if (auto res = sock_.udp_gro(true); !res) {
+	    svc_->on_error(mon, sock_, res);
+	}
+    }
+    svc_->on_attached(mon, sock_);
+}
+
+
+void
+datagram_receiver::on_event(monitor& mon, int, uint32_t)
+{
+    stats_.n_event++;
+    for (int k = 0; k < conf_.max_batches && sock_; k++) {
+	for (int i = 0; i < conf_.batch_size; i++) {
+	    dgs_[i].buf = arena_.data() + i * conf_.slot_size;
+	    dgs_[i].size = conf_.slot_size;
+	}
+	auto res = sock_.recvmmsg(dgs_.data(), conf_.batch_size);
+	if (!res) {
+	    if (!res.has_what(EWOULDBLOCK)) {
+		svc_->on_error(mon, sock_, res);
+	    }
+	    return;
+	}
+	int n = res.value();
+	stats_.n_recvmmsg++;
+	stats_.n_datagram += n;
+	for (int i = 0; i < n; i++) {
+	    stats_.n_bytes += dgs_[i].size;
+	}
+	svc_->on_datagrams(mon, sock_, dgs_.data(), n);
+	if (n < conf_.batch_size) {
+	    return;			// socket has been drained
+	}
+    }
+}
+
+
+void
+datagram_receiver::on_unmanage(monitor& mon, int)
+{
+    svc_->on_detached(mon, sock_);
+}
+
+
+void
+datagram_receiver::stats_t::print(std::ostream& out, const std::string&) const
+{
+    c7::format(out, "event:%{}, recvmmsg:%{}, datagram:%{}, bytes:%{}",
+	       n_event, n_recvmmsg, n_datagram, n_bytes);
+}
+
+
+result<>
+manage_datagram_receiver(c7::socket&& sock,
+			 std::shared_ptr<datagram_service_interface> svc,
+			 const datagram_receiver::config& conf)
+{
+    return manage(datagram_receiver::make(std::move(sock), std::move(svc), conf));
+}
+
+
+result<>
+manage_datagram_receiver(monitor& mon,
+			 c7::socket&& sock,
+			 std::shared_ptr<datagram_service_interface> svc,
+			 const datagram_receiver::config& conf)
+{
+    return mon.manage(datagram_receiver::make(std::move(sock), std::move(svc), conf));
+}
+
+
+} // namespace c7::event
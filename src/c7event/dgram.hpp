@@ -0,0 +1,114 @@
+/*
+ * c7event/dgram.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google document:
+ * https://docs.google.com/document/d/1_2Pj_MDBpX0PwGYouK46sXM1qWyUOi8iUv1zynuXqA0/edit?usp=sharing
+ */
+#ifndef C7_EVENT_DGRAM_HPP_LOADED_
+#define C7_EVENT_DGRAM_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7event/monitor.hpp>
+#include <c7socket.hpp>
+#include <vector>
+
+
+namespace c7::event {
+
+
+// service for datagram_receiver
+// -----------------------------
+
+class datagram_service_interface {
+public:
+    virtual ~datagram_service_interface() = default;
+
+    virtual void on_attached(monitor&, c7::socket&) {}
+    virtual void on_detached(monitor&, c7::socket&) {}
+
+    // dgs[0..n) is received batch. Buffers of them are valid only in this call.
+    // If dgs[i].gso_size is not zero (UDP_GRO), dgs[i].buf contains some datagrams
+    // of gso_size bytes (last one may be shorter).
+    virtual void on_datagrams(monitor&, c7::socket&, c7::datagram *dgs, int n) = 0;
+
+    // recvmmsg failed except EWOULDBLOCK. receiver is unmanaged after this call
+    // if socket is closed in this call.
+    virtual void on_error(monitor&, c7::socket&, c7::result_base&) {}
+};
+
+
+// datagram receiver
+// -----------------
+//
+// - datagrams are received into a preallocated arena (batch_size slots of slot_size
+//   bytes) by recvmmsg, and whole batch is passed to on_datagrams.
+// - on_event repeats recvmmsg until EWOULDBLOCK or max_batches, so that a busy
+//   socket doesn't starve other providers.
+
+struct datagram_receiver_config {
+    int batch_size = 64;		// # of datagrams received by one recvmmsg
+					// (limited to c7::socket::mmsg_max)
+    size_t slot_size = 2048;		// buffer size for each datagram
+    int max_batches = 16;		// maximum # of recvmmsg for one event
+    bool gro = false;			// enable UDP_GRO (slot_size should be 64KiB)
+};
+
+class datagram_receiver: public provider_interface {
+public:
+    using config = datagram_receiver_config;
+
+    struct stats_t {
+	uint64_t n_event;	// # of EPOLLIN events
+	uint64_t n_recvmmsg;	// # of recvmmsg calls which received something
+	uint64_t n_datagram;	// # of received datagrams (coalesced one is counted as 1)
+	uint64_t n_bytes;	// # of received bytes
+
+	void print(std::ostream& out, const std::string&) const;
+    };
+
+    static std::shared_ptr<datagram_receiver>
+    make(c7::socket&& sock, std::shared_ptr<datagram_service_interface> svc,
+	 const config& conf = config());
+
+    ~datagram_receiver() override {}
+    int fd() override;
+    void on_manage(monitor& mon, int prvfd) override;
+    void on_event(monitor& mon, int prvfd, uint32_t events) override;
+    void on_unmanage(monitor&, int prvfd) override;
+
+    c7::socket& socket() { return sock_; }
+    const stats_t& stats() const { return stats_; }
+
+private:
+    c7::socket sock_;
+    std::shared_ptr<datagram_service_interface> svc_;
+    config conf_;
+    std::vector<char> arena_;
+    std::vector<c7::datagram> dgs_;
+    stats_t stats_ = {};
+
+    datagram_receiver(c7::socket&& sock, std::shared_ptr<datagram_service_interface>&& svc,
+		      const config& conf);
+};
+
+
+result<> manage_datagram_receiver(c7::socket&& sock,
+				  std::shared_ptr<datagram_service_interface> svc,
+				  const datagram_receiver_config& conf = datagram_receiver_config());
+
+result<> manage_datagram_receiver(monitor& mon,
+				  c7::socket&& sock,
+				  std::shared_ptr<datagram_service_interface> svc,
+				  const datagram_receiver_config& conf = datagram_receiver_config());
+
+
+} // namespace c7::event
+
+
+#endif // c7event/dgram.hpp
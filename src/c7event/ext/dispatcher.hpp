@@ -15,7 +15,14 @@
 
 
 #include <c7event/service.hpp>
+#include <c7thread/mutex.hpp>
 #include <c7typefunc.hpp>
+#include <c7utils/histogram.hpp>
+#include <c7utils/time.hpp>
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 
 
 namespace c7::event::ext {
@@ -55,6 +62,105 @@ struct dispatcher_hooks<Msgbuf, Port> {
 };
 
 
+// statistics hook for dispatcher
+// ------------------------------
+//
+// - counts calls and measures latency (nano seconds) of callback for each event.
+//
+//      class my_service:
+//          public dispatcher<my_service, service_interface<mbuf>,
+//                            dispatcher_stats_hook<mbuf, socket_port>> {
+//
+// - event number and start time are taken by enter_callback, because callback may
+//   reuse or move the message. They are kept for each thread, so that a service
+//   object may be shared by services on multiple monitors.
+// - statistics are updated under a lock, and dispatcher_stats() returns a copy.
+
+template <typename Msgbuf, typename Port>
+class dispatcher_stats_hook {
+public:
+    struct event_stats {
+	uint64_t n_call;
+	c7::log2_histogram latency_ns;
+    };
+
+    void enter_callback(monitor&, Port&, Msgbuf& msg) {
+	frames_.push_back(frame{get_event(msg), c7::monotonic_ns()});
+    }
+
+    void exit_callback(monitor&, Port&, Msgbuf&) {
+	auto fr = frames_.back();
+	frames_.pop_back();
+	auto elapsed = c7::monotonic_ns() - fr.enter_ns;
+	auto unlock = stats_lock_.lock();
+	auto& st = event_stats_of(fr.ev);
+	st.n_call++;
+	st.latency_ns.add(elapsed);
+    }
+
+    // statistics of ev, or nullopt if ev has never been dispatched.
+    std::optional<event_stats> dispatcher_stats(int32_t ev) const {
+	auto unlock = stats_lock_.lock();
+	if (0 <= ev && size_t(ev) < dense_.size()) {
+	    if (dense_[ev].n_call == 0) {
+		return std::nullopt;
+	    }
+	    return dense_[ev];
+	}
+	if (auto it = sparse_.find(ev); it != sparse_.end()) {
+	    return (*it).second;
+	}
+	return std::nullopt;
+    }
+
+    // call func(event, stats) for each event which has been dispatched. func is
+    // called under the lock, so that it must not call dispatcher_stats*().
+    template <typename Func>
+    void dispatcher_stats_foreach(Func func) const {
+	auto unlock = stats_lock_.lock();
+	for (size_t ev = 0; ev < dense_.size(); ev++) {
+	    if (dense_[ev].n_call != 0) {
+		func(int32_t(ev), dense_[ev]);
+	    }
+	}
+	for (auto& [ev, st]: sparse_) {
+	    func(ev, st);
+	}
+    }
+
+    void dispatcher_stats_clear() {
+	auto unlock = stats_lock_.lock();
+	dense_.clear();
+	sparse_.clear();
+    }
+
+private:
+    static constexpr int32_t dense_limit = 4096;
+
+    struct frame {
+	int32_t ev;
+	int64_t enter_ns;
+    };
+
+    // callbacks may be nested on a thread (e.g. on_message of other service is called)
+    static inline thread_local std::vector<frame> frames_;
+
+    mutable c7::thread::mutex stats_lock_;
+    std::vector<event_stats> dense_;
+    std::unordered_map<int32_t, event_stats> sparse_;
+
+    event_stats& event_stats_of(int32_t ev) {
+	if (0 <= ev && ev < dense_limit) {
+	    if (size_t(ev) >= dense_.size()) {
+		dense_.resize(ev + 1);
+	    }
+	    return dense_[ev];
+	}
+	return sparse_[ev];
+    }
+};
+
+
 // event dispatch extention
 // ------------------------
 //
@@ -145,6 +251,9 @@ struct dispatcher_hooks<Msgbuf, Port> {
 //          //[dispatcher:setup end]
 //      }
 //
+// - callbacks are frozen into a flat jump table indexed by (event - base) after
+//   dispatcher_setup. Events far from the densest range are looked up by hash map.
+//
 template <typename DerivedService, typename BaseService, typename... Hooks>
 class dispatcher:
 	public BaseService,
@@ -159,14 +268,15 @@ public:
 
     dispatcher() {
 	static_cast<DerivedService*>(this)->dispatcher_setup();
+	freeze_table();
     }
 
     void on_message(monitor& mon, port_type& port, msgbuf_type& msg) override {
 	BaseService::on_message(mon, port, msg);
-	auto& evmap = dispatcher_.event_map;
-	if (auto it = evmap.find(get_event(msg)); it != evmap.end()) {
-	    auto [_, vec_index] = (*it).second;
-	    auto mfp = dispatcher_.callback_vec[vec_index];
+	if (!dispatcher_.frozen) {
+	    freeze_table();
+	}
+	if (auto mfp = find_callback(get_event(msg)); mfp != nullptr) {
 	    hooks_base::enter_callback(mon, port, msg);
 	    (static_cast<DerivedService*>(this)->*mfp)(mon, port, msg);
 	    hooks_base::exit_callback(mon, port, msg);
@@ -192,15 +302,71 @@ protected:
     }
 
 private:
+    // maximum gap of event numbers which are put into same jump table
+    static constexpr int32_t table_max_gap = 8;
+
     struct {
 	std::unordered_map<int32_t, std::pair<int, int>> event_map;
 	std::vector<memfunc_ptr> callback_vec;
+	int32_t table_base = 0;
+	std::vector<memfunc_ptr> table;		// callback of (table_base + index)
+	bool frozen = false;
     } dispatcher_;
 
+    memfunc_ptr find_callback(int32_t ev) {
+	auto& table = dispatcher_.table;
+	uint32_t index = uint32_t(ev) - uint32_t(dispatcher_.table_base);
+	if (index < table.size()) {
+	    return table[index];
+	}
+	auto& evmap = dispatcher_.event_map;
+	if (auto it = evmap.find(ev); it != evmap.end()) {
+	    return dispatcher_.callback_vec[(*it).second.second];
+	}
+	return nullptr;
+    }
+
+    // build jump table for the range which has most events and no large gap.
+    void freeze_table() {
+	auto& evmap = dispatcher_.event_map;
+	auto& table = dispatcher_.table;
+
+	std::vector<int32_t> evs;
+	evs.reserve(evmap.size());
+	for (auto& [ev, _]: evmap) {
+	    evs.push_back(ev);
+	}
+	std::sort(evs.begin(), evs.end());
+
+	size_t best_beg = 0, best_end = 0;
+	for (size_t beg = 0, end; beg < evs.size(); beg = end) {
+	    for (end = beg + 1;
+		 end < evs.size() && int64_t(evs[end]) - evs[end-1] <= table_max_gap;
+		 end++);
+	    if (end - beg > best_end - best_beg) {
+		best_beg = beg;
+		best_end = end;
+	    }
+	}
+
+	table.clear();
+	if (best_end > best_beg) {
+	    dispatcher_.table_base = evs[best_beg];
+	    table.resize(evs[best_end-1] - evs[best_beg] + 1, nullptr);
+	    for (auto i = best_beg; i < best_end; i++) {
+		auto vec_index = evmap[evs[i]].second;
+		table[evs[i] - dispatcher_.table_base] = dispatcher_.callback_vec[vec_index];
+	    }
+	}
+	dispatcher_.frozen = true;
+    }
+
     void set_callback(int32_t ev_beg, int32_t ev_end, memfunc_ptr mfp, int prio) {
 	auto& cbvec = dispatcher_.callback_vec;
 	auto& evmap = dispatcher_.event_map;
 
+	dispatcher_.frozen = false;
+
 	int vec_index = -1;
 	if (auto it = find(cbvec.begin(), cbvec.end(), mfp); it != cbvec.end()) {
 	    vec_index = it - cbvec.begin();
@@ -15,7 +15,10 @@
 
 
 #include <c7event/service.hpp>
+#include <c7thread/fastlock.hpp>
 #include <list>
+#include <memory>
+#include <unordered_map>
 #include <unordered_set>
 
 
@@ -30,6 +33,98 @@ template <typename, typename>
 class forwarder_broker;
 
 
+template <typename, typename>
+class forwarder_proxy;
+
+
+// subscription table
+// ------------------
+//
+// - forwarder_broker keeps an immutable snapshot which maps an event number to
+//   the subscribers and their callbacks. The snapshot is rebuilt and swapped
+//   only when a proxy changes its callback or interests, or is released.
+// - forward() takes the current snapshot under a spinlock which is held only to
+//   copy the shared_ptr (the table mutex is not taken), and finds subscribers of
+//   the message by one lookup.
+// - Callbacks of a released proxy are dropped by the rebuild on its release, and
+//   freed when the last forward() using the previous snapshot returns.
+
+template <typename Msgbuf, typename Port>
+class forwarder_table {
+private:
+    using proxy = forwarder_proxy<Msgbuf, Port>;
+    using callback_t = typename proxy::callback_t;
+
+    template <typename, typename>
+    friend class forwarder_proxy;
+
+    template <typename, typename>
+    friend class forwarder_broker;
+
+    struct entry {
+	std::weak_ptr<proxy> wp;
+	std::shared_ptr<const std::function<callback_t>> callback;
+    };
+
+    struct snapshot {
+	std::vector<entry> all;		// called for disconnection and error
+	std::unordered_map<int32_t, std::vector<entry>> by_event;
+    };
+
+    c7::thread::mutex mutex_;
+    std::list<std::weak_ptr<proxy>> proxies_;
+    c7::thread::ttas_spinlock snapshot_lock_;
+    std::shared_ptr<const snapshot> snapshot_ = std::make_shared<snapshot>();
+
+    void add(const std::shared_ptr<proxy>& p) {
+	auto unlock = mutex_.lock();
+	proxies_.push_back(p);
+    }
+
+    // rebuild snapshot from current state of proxies
+    void rebuild() {
+	// proxies and previous snapshot are released after unlock, because releasing
+	// the last reference of a proxy calls rebuild() again.
+	std::vector<std::shared_ptr<proxy>> holds;
+	std::shared_ptr<const snapshot> prev;
+
+	auto unlock = mutex_.lock();
+	auto snap = std::make_shared<snapshot>();
+	for (auto it = proxies_.begin(); it != proxies_.end();) {
+	    auto sp = (*it).lock();
+	    if (!sp) {
+		it = proxies_.erase(it);
+		continue;
+	    }
+	    ++it;
+	    auto proxy_unlock = sp->mutex_.lock();
+	    if (sp->interests_.empty() || !sp->callback_) {
+		holds.push_back(std::move(sp));
+		continue;
+	    }
+	    entry ent{sp, sp->callback_};
+	    for (auto e: sp->interests_) {
+		snap->by_event[e].push_back(ent);
+	    }
+	    snap->all.push_back(std::move(ent));
+	    proxy_unlock();
+	    holds.push_back(std::move(sp));
+	}
+	{
+	    auto snapshot_unlock = snapshot_lock_.lock();
+	    prev = std::move(snapshot_);
+	    snapshot_ = std::move(snap);
+	}
+	unlock();
+    }
+
+    std::shared_ptr<const snapshot> load() {
+	auto unlock = snapshot_lock_.lock();
+	return snapshot_;
+    }
+};
+
+
 template <typename Msgbuf, typename Port = socket_port>
 class forwarder_proxy {
 public:
@@ -38,43 +133,52 @@ public:
 
     void set_callback(const std::function<callback_t>& cb) {
 	auto unlock = mutex_.lock();
-	callback_ = cb;
+	if (cb) {
+	    callback_ = std::make_shared<const std::function<callback_t>>(cb);
+	} else {
+	    callback_.reset();
+	}
+	unlock();
+	table_->rebuild();
     }
     void subscribe(const std::vector<int32_t> interests) {
 	auto unlock = mutex_.lock();
 	interests_.insert(interests.begin(), interests.end());
+	unlock();
+	table_->rebuild();
     }
     void unsubscribe(const std::vector<int32_t> interests) {
 	auto unlock = mutex_.lock();
 	for (auto e: interests) {
 	    interests_.erase(e);
 	}
+	unlock();
+	table_->rebuild();
     }
     void unsubscribe() {
 	auto unlock = mutex_.lock();
 	interests_.clear();
+	unlock();
+	table_->rebuild();
+    }
+
+    explicit forwarder_proxy(const std::shared_ptr<forwarder_table<Msgbuf, Port>>& table):
+	table_(table) {
+    }
+
+    // drop callback of this proxy from the snapshot
+    ~forwarder_proxy() {
+	table_->rebuild();
     }
 
 private:
     template <typename, typename>
-    friend class forwarder_broker;
+    friend class forwarder_table;
 
     std::unordered_set<int32_t> interests_;
-    std::function<callback_t> callback_;
+    std::shared_ptr<const std::function<callback_t>> callback_;
     c7::thread::mutex mutex_;
-
-    void call(monitor& mon, Port& port, io_result& res, Msgbuf& msg) {
-	auto unlock = mutex_.lock();
-	auto callback = callback_;
-	if (interests_.empty() || !callback) {
-	    return;
-	}
-	auto match = (interests_.find(get_event(msg)) != interests_.end());
-	unlock();
-	if (match || !res) {
-	    callback(mon, port, res, msg);
-	}
-    }
+    std::shared_ptr<forwarder_table<Msgbuf, Port>> table_;
 };
 
 
@@ -82,36 +186,36 @@ template <typename Msgbuf, typename Port = socket_port>
 class forwarder_broker {
 private:
     using proxy = forwarder_proxy<Msgbuf, Port>;
+    using table = forwarder_table<Msgbuf, Port>;
 
     template <typename>
     friend class forwarder;
 
-    c7::thread::mutex mutex_;
-    std::list<std::weak_ptr<proxy>> proxies_;
+    std::shared_ptr<table> table_ = std::make_shared<table>();
 
-    void forward(monitor& mon, Port& port, io_result& res, Msgbuf& msg) {
-	std::vector<std::shared_ptr<proxy>> spv;
-	auto unlock = mutex_.lock();
-	for (auto it = proxies_.begin(); it != proxies_.end();) {
-	    auto sp = (*it).lock();
-	    if (!sp) {
-		it = proxies_.erase(it);
-	    } else {
-		++it;
-		spv.push_back(std::move(sp));
+    static void call(const std::vector<typename table::entry>& entries,
+		     monitor& mon, Port& port, io_result& res, Msgbuf& msg) {
+	for (auto& ent: entries) {
+	    // callback is not called after proxy is released.
+	    if (auto sp = ent.wp.lock(); sp) {
+		(*ent.callback)(mon, port, res, msg);
 	    }
 	}
-	unlock();
-	for (auto sp: spv) {
-	    sp->call(mon, port, res, msg);
+    }
+
+    void forward(monitor& mon, Port& port, io_result& res, Msgbuf& msg) {
+	auto snap = table_->load();
+	if (!res) {
+	    call(snap->all, mon, port, res, msg);
+	} else if (auto it = snap->by_event.find(get_event(msg)); it != snap->by_event.end()) {
+	    call((*it).second, mon, port, res, msg);
 	}
     }
 
 public:
     std::shared_ptr<proxy> operator()() {
-	auto unlock = mutex_.lock();
-	auto p = std::make_shared<proxy>();
-	proxies_.push_back(p);
+	auto p = std::make_shared<proxy>(table_);
+	table_->add(p);
 	return p;
     }
 };
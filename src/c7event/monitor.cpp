@@ -15,17 +15,69 @@
 #include <c7mlog.hpp>
 #include <c7signal.hpp>
 #include <c7thread/thread.hpp>
+#include <c7utils/time.hpp>
+#include <cxxabi.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
+#include <cstdlib>
 #include <mutex>		// once_flag
+#include <typeinfo>
 
 
 namespace c7::event {
 
 
+/*----------------------------------------------------------------------------
+                                 monitor_stats
+----------------------------------------------------------------------------*/
+
+void
+monitor_stats::clear()
+{
+    n_wakeup = 0;
+    events_per_wakeup.clear();
+    iteration_ns.clear();
+    for (auto& [_, ps]: providers) {
+	ps = provider_stats{};
+    }
+    slow_handlers.clear();
+}
+
+void
+monitor_stats::print(std::ostream& out, const std::string&) const
+{
+    c7::format(out, "wakeup:%{}, events/wakeup:{%{}}, iteration_ns:{%{}}",
+	       n_wakeup, events_per_wakeup, iteration_ns);
+    for (auto& [key, ps]: providers) {
+	if (ps.n_call != 0) {
+	    c7::format(out, "\n %{}: call:%{}, handler_ns:{%{}}", key, ps.n_call, ps.handler_ns);
+	}
+    }
+    for (auto& sh: slow_handlers) {
+	c7::format(out, "\n slow: %{}: prvfd:%{}, events:%{#x}, %{}ns, at %{t%m/%d %H:%M:%S}",
+		   sh.provider, sh.prvfd, sh.events, sh.duration_ns, sh.time_us);
+    }
+}
+
+
 /*----------------------------------------------------------------------------
                                     monitor
 ----------------------------------------------------------------------------*/
 
+static std::string
+type_name_of(provider_interface& prv)
+{
+    auto name = typeid(prv).name();
+    int status;
+    if (auto s = abi::__cxa_demangle(name, nullptr, nullptr, &status); s != nullptr) {
+	std::string dname(s);
+	std::free(s);
+	return dname;
+    }
+    return name;
+}
+
+
 monitor::monitor():
     lock_(true)				// true: RECURSIVE mutex
 {
@@ -33,17 +85,37 @@ monitor::monitor():
 
 monitor::monitor(monitor&& o):
     epfd_(o.epfd_),
+    wakefd_(o.wakefd_),
     prvdic_(std::move(o.prvdic_)),
     keyprvdic_(std::move(o.keyprvdic_)),
-    lock_(true)				// true: RECURSIVE mutex
+    lock_(true),			// true: RECURSIVE mutex
+    posted_(std::move(o.posted_)),
+    has_posted_(o.has_posted_.load()),
+    stats_enabled_(o.stats_enabled_.load())
 {
     o.epfd_ = C7_SYSERR;
+    o.wakefd_ = C7_SYSERR;
+    o.has_posted_ = false;
+
+    // stats of providers are resolved again into stats_ of this monitor.
+    {
+	auto unlock = o.stats_lock_.lock();
+	stats_ = std::move(o.stats_);
+	slow_next_ = o.slow_next_;
+	next_dump_ns_ = o.next_dump_ns_;
+	o.stats_ = monitor_stats();
+    }
+    for (auto& [_, pinfo]: prvdic_) {
+	pinfo.stats = nullptr;
+    }
+    o.samples_.clear();
 }
 
 monitor::~monitor()
 {
     unmanage_all();
     ::close(epfd_);
+    ::close(wakefd_);
 }
 
 result<>
@@ -54,33 +126,212 @@ monitor::init()
     if (epfd_ == C7_SYSERR) {
 	return c7result_err(errno, "epoll_create1() failed");
     }
+    wakefd_ = ::eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+    if (wakefd_ == C7_SYSERR) {
+	return c7result_err(errno, "eventfd() failed");
+    }
+    ::epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = wakefd_;
+    if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, wakefd_, &ev) == C7_SYSERR) {
+	return c7result_err(errno, "epoll_ctl(ADD, %{}) failed", wakefd_);
+    }
     return c7result_ok();
 }
 
+void
+monitor::dispatch(const ::epoll_event& ev, bool posted, bool stats)
+{
+    uint32_t events = ev.events;
+
+    // IMPORTANT: It's possible that a provider has been unmanage here.
+    //            So, it is important to check the exsitency of provider and
+    //            hold it to prevent some thread from freeing the provider.
+    std::shared_ptr<provider_interface> hold;
+    stats_node *node = nullptr;
+    {
+	auto unlock = lock_.lock();
+	auto it = prvdic_.find(ev.data.fd);
+	if (it == prvdic_.end()) {
+	    return;
+	}
+	if (posted) {
+	    // posted event is masked by current events, and ignored while suspended.
+	    uint32_t cur = (*it).second.events;
+	    events &= ((cur & EPOLLHUP) != 0) ? 0 : cur;
+	    if (events == 0) {
+		return;
+	    }
+	}
+	hold = (*it).second.s_ptr;	// to prevent other thread from freeing the provider
+	if (stats) {
+	    node = resolve_stats((*it).second);
+	}
+    }
+    if (!stats) {
+	hold->on_event(*this, ev.data.fd, events);
+	return;
+    }
+    auto beg = c7::monotonic_ns();
+    hold->on_event(*this, ev.data.fd, events);
+    auto dur = c7::monotonic_ns() - beg;
+    samples_.push_back(stats_sample{node, ev.data.fd, events, static_cast<uint64_t>(dur)});
+}
+
+monitor::stats_node *
+monitor::resolve_stats(provider_info& pinfo)
+{
+    if (pinfo.stats == nullptr) {
+	auto key = pinfo.key.empty() ? type_name_of(*pinfo.s_ptr) : pinfo.key;
+	auto unlock = stats_lock_.lock();
+	// [MEMO] node of unordered_map is never moved by rehash, and entries of
+	//        providers are never erased. So, pointer to node is kept valid.
+	pinfo.stats = &*stats_.providers.try_emplace(std::move(key)).first;
+    }
+    return pinfo.stats;
+}
+
+bool
+monitor::stats_enabled() const
+{
+    return (stats_enabled_.load(std::memory_order_relaxed) ||
+	    c7::dconf[C7_DCONF_EVENT_STATS].i != 0);
+}
+
+void
+monitor::commit_stats(int64_t wakeup_ns, int n_event)
+{
+    auto now = c7::monotonic_ns();
+    auto slow_ns = c7::dconf[C7_DCONF_EVENT_SLOW_US].i;
+    slow_ns = ((slow_ns > 0) ? slow_ns : 10000) * 1000;
+
+    auto unlock = stats_lock_.lock();
+    stats_.n_wakeup++;
+    stats_.events_per_wakeup.add(n_event);
+    stats_.iteration_ns.add(now - wakeup_ns);
+    for (auto& sm: samples_) {
+	auto& ps = sm.stats->second;
+	ps.n_call++;
+	ps.handler_ns.add(sm.duration_ns);
+	if (sm.duration_ns >= static_cast<uint64_t>(slow_ns)) {
+	    monitor_stats::slow_handler sh {
+		c7::time_us(), sm.prvfd, sm.events, sm.duration_ns, sm.stats->first
+	    };
+	    if (stats_.slow_handlers.size() < monitor_stats::slow_handler_max) {
+		stats_.slow_handlers.push_back(std::move(sh));
+	    } else {
+		stats_.slow_handlers[slow_next_] = std::move(sh);
+		slow_next_ = (slow_next_ + 1) % monitor_stats::slow_handler_max;
+	    }
+	}
+    }
+    unlock();
+    samples_.clear();
+}
+
+// dump stats into mlog if interval has elapsed, and return timeout [ms] of
+// epoll_wait for next dump (-1: no dump).
+int
+monitor::dump_stats_timeout()
+{
+    auto interval_s = c7::dconf[C7_DCONF_EVENT_STATS_DUMP].i;
+    if (interval_s <= 0) {
+	next_dump_ns_ = 0;
+	return -1;
+    }
+    auto now = c7::monotonic_ns();
+    auto interval_ns = interval_s * 1000'000'000;
+    if (next_dump_ns_ == 0) {
+	next_dump_ns_ = now + interval_ns;
+    } else if (now >= next_dump_ns_) {
+	c7::mlog.format(__FILE__, __LINE__, C7_LOG_INF, C7_MLOG_C_MAX, 0,
+			"monitor stats: %{}", stats());
+	next_dump_ns_ = now + interval_ns;
+    }
+    return static_cast<int>((next_dump_ns_ - now + 999'999) / 1000'000);
+}
+
+monitor_stats
+monitor::stats()
+{
+    auto unlock = stats_lock_.lock();
+    auto snap = stats_;
+    unlock();
+    // slow_handlers is ring buffer: rotate to make oldest first.
+    if (snap.slow_handlers.size() == monitor_stats::slow_handler_max) {
+	std::rotate(snap.slow_handlers.begin(),
+		    snap.slow_handlers.begin() + slow_next_,
+		    snap.slow_handlers.end());
+    }
+    return snap;
+}
+
+void
+monitor::clear_stats()
+{
+    auto unlock = stats_lock_.lock();
+    stats_.clear();
+    slow_next_ = 0;
+}
+
 void
 monitor::loop()
 {
+    std::unordered_map<int, uint32_t> posted;
+
+    loop_thread_ = ::pthread_self();
+
     for (;;) {
+	if (has_posted_.load(std::memory_order_acquire)) {
+	    auto unlock = lock_.lock();
+	    posted.swap(posted_);
+	    has_posted_.store(false, std::memory_order_relaxed);
+	}
+
+	bool stats = stats_enabled();
+	int timeout = posted.empty() ? -1 : 0;
+	if (stats) {
+	    if (auto tmo = dump_stats_timeout(); tmo != -1 && timeout != 0) {
+		timeout = tmo;
+	    }
+	}
+
 	::epoll_event evts[8];
-	int ret = ::epoll_wait(epfd_, evts, c7_numberof(evts), -1);
+	int ret = ::epoll_wait(epfd_, evts, c7_numberof(evts), timeout);
+	int64_t wakeup_ns = stats ? c7::monotonic_ns() : 0;
+	int n_event = 0;
 	if (ret > 0) {
 	    for (int i = 0; i < ret; i++) {
 		auto ev = evts[i];
-		// IMPORTANT: It's possible that a provider has been unmanage here.
-		//            So, it is important to check the exsitency of provider and
-		//            hold it to prevent some thread from freeing the provider.
-		std::shared_ptr<provider_interface> hold;
-		{
-		    auto unlock = lock_.lock();
-		    auto it = prvdic_.find(ev.data.fd);
-		    if (it == prvdic_.end()) {
-			continue;
-		    }
-		    hold = (*it).second.s_ptr;	// to prevent other thread from freeing the provider
+		if (ev.data.fd == wakefd_) {
+		    uint64_t n;
+		    c7::drop = ::read(wakefd_, &n, sizeof(n));
+		    continue;
 		}
-		hold->on_event(*this, ev.data.fd, ev.events);
+		// posted event for same provider is merged not to call on_event twice.
+		if (auto it = posted.find(ev.data.fd); it != posted.end()) {
+		    ev.events |= (*it).second;
+		    (*it).second = 0;
+		}
+		dispatch(ev, false, stats);
+		n_event++;
+	    }
+	}
+	for (auto [prvfd, events]: posted) {
+	    if (events != 0) {
+		::epoll_event pev;
+		pev.events = events;
+		pev.data.fd = prvfd;
+		dispatch(pev, true, stats);
+		n_event++;
 	    }
-	} else if (ret == C7_SYSERR) {
+	}
+	posted.clear();
+	if (stats && n_event > 0) {
+	    commit_stats(wakeup_ns, n_event);
+	}
+
+	if (ret == C7_SYSERR) {
 	    if (errno != EINTR) {
 		// FATAL ERROR
 		c7abort(c7result_err(errno, "epoll_wait() failed"));
@@ -126,7 +377,7 @@ monitor::manage(const std::string& key,
 	return c7result_err(errno, "epoll_ctl(ADD, %{}) failed", prvfd);
     }
 
-    provider_info prv_info { provider, events };
+    provider_info prv_info { provider, events, key };
     prvdic_.insert_or_assign(prvfd, std::move(prv_info));
 
     if (!key.empty()) {
@@ -193,6 +444,24 @@ monitor::change_event(int prvfd, uint32_t events)
     return c7result_ok();
 }
 
+result<uint32_t>
+monitor::modify_event(int prvfd, uint32_t on_events, uint32_t off_events)
+{
+    auto unlock = lock_.lock();
+    auto it = prvdic_.find(prvfd);
+    if (it == prvdic_.end()) {
+	return c7result_err(ENOENT, "prvfd:%{} is not manage.", prvfd);
+    }
+    uint32_t old_events = (*it).second.events & ~EPOLLHUP;
+    uint32_t events = ((old_events | on_events) & ~off_events) & ~EPOLLHUP;
+    if (events != old_events) {
+	if (auto res = change_event(prvfd, events); !res) {	// lock_ is recursive
+	    return res.as_error();
+	}
+    }
+    return c7result_ok(old_events);
+}
+
 result<>
 monitor::change_provider(int prvfd, std::shared_ptr<provider_interface> provider)
 {
@@ -203,6 +472,7 @@ monitor::change_provider(int prvfd, std::shared_ptr<provider_interface> provider
     }
     auto sp = provider.get();
     (*it).second.s_ptr = std::move(provider);
+    (*it).second.stats = nullptr;
     unlock();
 
     sp->on_manage(*this, prvfd);
@@ -268,6 +538,22 @@ monitor::unmanage(int prvfd)
     return c7result_ok();
 }
 
+void
+monitor::post_event(int prvfd, uint32_t events)
+{
+    auto unlock = lock_.lock();
+    bool first = posted_.empty();
+    posted_[prvfd] |= events;
+    has_posted_.store(true, std::memory_order_release);
+    unlock();
+
+    // loop thread checks posted_ before next epoll_wait by itself.
+    if (first && !::pthread_equal(loop_thread_.load(), ::pthread_self())) {
+	uint64_t n = 1;
+	c7::drop = ::write(wakefd_, &n, sizeof(n));
+    }
+}
+
 void
 monitor::unmanage_all()
 {
@@ -366,6 +652,12 @@ change_event(int prvfd, uint32_t events)
     return default_monitor.change_event(prvfd, events);
 }
 
+result<uint32_t>
+modify_event(int prvfd, uint32_t on_events, uint32_t off_events)
+{
+    return default_monitor.modify_event(prvfd, on_events, off_events);
+}
+
 result<>
 suspend(int prvfd)
 {
@@ -412,7 +704,7 @@ submit(std::function<void()>&& f)
     return c7result_err(EFAULT, "Failed to install submit_provider");
 }
 
-c7::defer lock()
+c7::thread::lock_guard<c7::thread::mutex> lock()
 {
     return default_event_monitor().lock();
 }
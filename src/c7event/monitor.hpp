@@ -15,13 +15,21 @@
 
 
 #include <sys/epoll.h>
+#include <pthread.h>
+#include <atomic>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <c7result.hpp>
+#include <c7thread/fastlock.hpp>
 #include <c7thread/mutex.hpp>
+#include <c7utils/histogram.hpp>
 
 
 #define C7_EVENT_MONITOR_API_SUBMIT	(1)
 #define C7_EVENT_MONITOR_API_LOCK	(1)
+#define C7_EVENT_MONITOR_API_STATS	(1)
 
 
 namespace c7::event {
@@ -53,6 +61,44 @@ protected:
 };
 
 
+// loop instrumentation
+// --------------------
+//
+// - Enabled by monitor::enable_stats(true) or dconf C7_DCONF_EVENT_STATS (checked
+//   at every iteration). While disabled, loop() does nothing extra except
+//   reading the flags.
+// - Handler durations are accumulated per provider, which is identified by the
+//   key of manage() or the type name of provider if key is empty.
+// - If dconf C7_DCONF_EVENT_STATS_DUMP is positive, stats are written into mlog
+//   at that interval [s] by the loop thread.
+
+struct monitor_stats {
+    struct provider_stats {
+	uint64_t n_call = 0;
+	c7::log2_histogram handler_ns;
+    };
+
+    struct slow_handler {
+	c7::usec_t time_us;
+	int prvfd;
+	uint32_t events;
+	uint64_t duration_ns;
+	std::string provider;
+    };
+
+    static constexpr size_t slow_handler_max = 32;
+
+    uint64_t n_wakeup = 0;
+    c7::log2_histogram events_per_wakeup;
+    c7::log2_histogram iteration_ns;	// wakeup to next epoll_wait (lag of other events)
+    std::unordered_map<std::string, provider_stats> providers;
+    std::vector<slow_handler> slow_handlers;	// recent outliers (oldest first)
+
+    void clear();
+    void print(std::ostream& out, const std::string& spec) const;
+};
+
+
 class monitor {
 public:
     monitor(const monitor&) = delete;
@@ -69,11 +115,19 @@ public:
     result<> manage(const std::string& key, std::shared_ptr<provider_interface> provider, uint32_t events = 0);
     result<> change_fd(int prvfd, int new_prvfd);
     result<> change_event(int prvfd, uint32_t events);
+    // set on_events and clear off_events atomically, and return previous events.
+    result<uint32_t> modify_event(int prvfd, uint32_t on_events, uint32_t off_events);
     result<> change_provider(int prvfd, std::shared_ptr<provider_interface> provider);
     result<> suspend(int prvfd);
     result<> resume(int prvfd);
     result<> unmanage(int prvfd);
 
+    // on_event of prvfd is called with events in next iteration of loop even if
+    // epoll reports nothing. (e.g. data remains in user space buffer)
+    // Events posted for same prvfd before the iteration are merged into one call,
+    // and loop is woken up if posted by other thread.
+    void post_event(int prvfd, uint32_t events);
+
     template <typename T = provider_interface>
     result<std::shared_ptr<T>> find(const std::string& key);
 
@@ -83,25 +137,58 @@ public:
     std::shared_ptr<provider_interface> try_hold_provider(int prvfd);
 
     // C7_EVENT_MONITOR_API_LOCK
-    [[nodiscard]] c7::defer lock() { return lock_.lock(); }
+    [[nodiscard]] c7::thread::lock_guard<c7::thread::mutex> lock() { return lock_.lock(); }
+
+    // C7_EVENT_MONITOR_API_STATS
+    void enable_stats(bool enable) { stats_enabled_ = enable; }
+    bool stats_enabled() const;
+    monitor_stats stats();		// snapshot
+    void clear_stats();
 
 private:
+    using stats_node = decltype(monitor_stats::providers)::value_type;
+
     struct provider_info {
 	provider_info() = default;
 	provider_info(provider_info&&) = default;
 	provider_info& operator=(provider_info&&) = default;
-	provider_info(std::shared_ptr<provider_interface> prv, uint32_t events):
-	    s_ptr(std::move(prv)), events(events) {}
+	provider_info(std::shared_ptr<provider_interface> prv, uint32_t events,
+		      const std::string& key):
+	    s_ptr(std::move(prv)), events(events), key(key) {}
 
 	std::shared_ptr<provider_interface> s_ptr;
 	uint32_t events;
+	std::string key;
+	stats_node *stats = nullptr;	// resolved on first event while stats enabled
+    };
+
+    struct stats_sample {
+	stats_node *stats;
+	int prvfd;
+	uint32_t events;
+	uint64_t duration_ns;
     };
 
     int epfd_ = C7_SYSERR;
+    int wakefd_ = C7_SYSERR;			// eventfd to wake up epoll_wait
     std::unordered_map<int, provider_info> prvdic_;
     std::unordered_map<std::string, std::weak_ptr<provider_interface>> keyprvdic_;
     c7::thread::mutex lock_;
-
+    std::unordered_map<int, uint32_t> posted_;	// prvfd -> events
+    std::atomic<bool> has_posted_ = false;
+    std::atomic<::pthread_t> loop_thread_ {};
+
+    std::atomic<bool> stats_enabled_ = false;
+    c7::thread::adaptive_mutex stats_lock_;
+    monitor_stats stats_;
+    size_t slow_next_ = 0;
+    int64_t next_dump_ns_ = 0;
+    std::vector<stats_sample> samples_;		// used only by loop thread
+
+    void dispatch(const ::epoll_event& ev, bool posted = false, bool stats = false);
+    stats_node *resolve_stats(provider_info& pinfo);
+    void commit_stats(int64_t wakeup_ns, int n_event);
+    int dump_stats_timeout();
     result<std::shared_ptr<provider_interface>> find_provider(const std::string& key);
     result<std::shared_ptr<provider_interface>> find_provider(int prvfd);
     void unmanage_all();
@@ -154,6 +241,8 @@ result<> change_fd(int prvfd, int new_prvfd);
 
 result<> change_event(int prvfd, uint32_t events);
 
+result<uint32_t> modify_event(int prvfd, uint32_t on_events, uint32_t off_events);
+
 result<> change_provider(int prvfd, std::shared_ptr<provider_interface> provider);
 
 result<> suspend(int prvfd);
@@ -180,7 +269,7 @@ std::shared_ptr<provider_interface> try_hold_provider(int prvfd);
 result<> submit(std::function<void()>&& f);
 
 // C7_EVENT_MONITOR_API_LOCK
-[[nodiscard]] c7::defer lock();
+[[nodiscard]] c7::thread::lock_guard<c7::thread::mutex> lock();
 
 result<> start_thread();
 
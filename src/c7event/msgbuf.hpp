@@ -14,9 +14,10 @@
 #include <c7common.hpp>
 
 
+#include <c7event/bufpool.hpp>
 #include <c7event/iovec_proxy.hpp>
 #include <c7event/portgroup.hpp>
-#include <c7utils/storage.hpp>
+#include <c7event/splice.hpp>
 
 
 // message buffer (default implementation)
@@ -39,6 +40,7 @@ public:
     multipart_msgbuf& operator=(multipart_msgbuf&& o);
     template <typename H2> multipart_msgbuf& operator=(multipart_msgbuf<H2, N>&& src);
 
+    // clear() give back storage to buffer_pool of current thread.
     void clear();
     multipart_msgbuf deep_copy() const;
     multipart_msgbuf& deep_copy_from(const multipart_msgbuf& src);
@@ -47,8 +49,24 @@ public:
     template <typename H2> multipart_msgbuf& deep_copy_iov_from(const multipart_msgbuf<H2, N>& src);
     template <typename H2> multipart_msgbuf& borrow_iov_from(const multipart_msgbuf<H2, N>& src);
 
+    // recv() read a message incrementally if Port has read_v. On non-blocking port,
+    // it return io_result::status::BUSY when the message is not yet completed and
+    // the next call continues to read rest of the message.
     template <typename Port> io_result recv(Port& port);
 
+    // relay() receives a message from in and sends it to out as it is. Only header is
+    // read into user space and parts are moved by splice(2) through the pipe, so that
+    // CPU cost doesn't depend on size of parts. After the call, header and size of each
+    // part ((*this)[i].iov_len) are available but contents of parts are not.
+    // On non-blocking in, it returns io_result::status::BUSY like recv() and the next
+    // call continues the message: parts are collected in the pipe (or in user space if
+    // they don't fit in the pipe) and nothing is written to out until all of them arrive.
+    // On blocking in, parts are streamed as they arrive.
+    // Writing to out waits as send() does, but data which cannot be written is queued
+    // if out has send queue (C7_EVENT_PORT_SEND_QUEUE).
+    template <typename InPort, typename OutPort>
+    io_result relay(InPort& in, OutPort& out, splice_pipe& pipe);
+
     template <typename Port> io_result send(Port& port, const Header&) const;
     template <typename Port> io_result send(Port& port) const {
 	return send(port, header);
@@ -68,7 +86,6 @@ private:
     friend class multipart_msgbuf;
 
     static constexpr int part_align_ = 8;
-    static constexpr int whole_align_ = 8192;
 
     struct internal_header {
 	Header header;
@@ -76,10 +93,32 @@ private:
     };
 
     mutable ::iovec iov_[N + 1];
-    c7::storage storage_ {whole_align_};
-
+    pooled_storage storage_;	// supplied by buffer_pool::this_thread()
+
+    // incremental receiving state
+    internal_header rcv_header_;
+    size_t rcv_done_ = 0;	// received bytes of current message (header and parts)
+
+    // incremental relaying state
+    enum class relay_state { HEADER, COPY, SPLICE };
+    relay_state rly_state_ = relay_state::HEADER;
+    size_t rly_rest_ = 0;	// bytes of parts not yet moved into the pipe
+
+    template <typename Port> result<> send_shared(portgroup<Port>& ports, const Header&) const;
+    std::shared_ptr<const char> serialize(const Header&, bool reverse_endian, size_t& size) const;
+    template <typename Port> io_result recv_v(Port& port);
+    template <typename Port> io_result recv_header(Port& port);
+    template <typename Port> io_result recv_failed(Port& port, io_result& iores);
+    template <typename InPort, typename OutPort>
+    io_result relay_stream(InPort& in, OutPort& out, splice_pipe& pipe, size_t total);
+    template <typename InPort> io_result relay_fill(InPort& in, splice_pipe& pipe);
+    template <typename InPort> io_result relay_to_copy(InPort& in, splice_pipe& pipe);
+    template <typename OutPort>
+    io_result relay_flush(OutPort& out, splice_pipe& pipe);
+    internal_header out_header(bool reverse_endian) const;
+    template <typename Port> io_result recv_n(Port& port);
     void setup_iov_len(const internal_header&, ::iovec (&)[N+1]);
-    result<> setup_iov_base(c7::storage&, ::iovec (&)[N+1]);
+    result<> setup_iov_base(pooled_storage&, ::iovec (&)[N+1]);
     template <typename H2> void copy_contents(const multipart_msgbuf<H2, N>& o);
     template <typename H2> void move_contents(multipart_msgbuf<H2, N>& o);
 
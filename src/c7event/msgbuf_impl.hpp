@@ -18,12 +18,18 @@
 #include <c7app.hpp>
 #include <c7event/msgbuf.hpp>
 #include <c7event/traits.hpp>
+#include <c7typefunc.hpp>
 #include <c7utils/endian.hpp>
 
 
 namespace c7::event {
 
 
+c7typefunc_define_has_member(read_v);
+c7typefunc_define_has_member(write_shared);
+c7typefunc_define_has_member(is_nonblocking_read);
+
+
 template <typename Header, int N>
 multipart_msgbuf<Header, N>::multipart_msgbuf():
     header(Header()), iov_{}
@@ -32,10 +38,14 @@ multipart_msgbuf<Header, N>::multipart_msgbuf():
 
 template <typename Header, int N>
 multipart_msgbuf<Header, N>::multipart_msgbuf(multipart_msgbuf&& o):
-    header(o.header), storage_(std::move(o.storage_))
+    header(o.header), storage_(std::move(o.storage_)),
+    rcv_header_(o.rcv_header_), rcv_done_(o.rcv_done_),
+    rly_state_(o.rly_state_), rly_rest_(o.rly_rest_)
 {
     std::memcpy(iov_, o.iov_, sizeof(iov_));
     o.clear();
+    o.rcv_done_ = 0;
+    o.rly_state_ = relay_state::HEADER;
 }
 
 template <typename Header, int N>
@@ -46,7 +56,13 @@ multipart_msgbuf<Header, N>::operator=(multipart_msgbuf&& o) -> multipart_msgbuf
 	header = o.header;
 	std::memcpy(iov_, o.iov_, sizeof(iov_));
 	storage_ = std::move(o.storage_);
+	rcv_header_ = o.rcv_header_;
+	rcv_done_ = o.rcv_done_;
+	rly_state_ = o.rly_state_;
+	rly_rest_ = o.rly_rest_;
 	o.clear();
+	o.rcv_done_ = 0;
+	o.rly_state_ = relay_state::HEADER;
     }
     return *this;
 }
@@ -67,6 +83,7 @@ void
 multipart_msgbuf<Header, N>::clear()
 {
     std::memset(&iov_[1], 0, sizeof(iov_) - sizeof(iov_[0]));
+    storage_.reset();
 }
 
 template <typename Header, int N>
@@ -124,6 +141,113 @@ template <typename Header, int N>
 template <typename Port>
 io_result
 multipart_msgbuf<Header, N>::recv(Port& port)
+{
+    if constexpr (has_read_v_v<Port>) {
+	return recv_v(port);
+    } else {
+	return recv_n(port);
+    }
+}
+
+template <typename Header, int N>
+template <typename Port>
+io_result
+multipart_msgbuf<Header, N>::recv_v(Port& port)
+{
+    constexpr size_t header_size = sizeof(internal_header);
+
+    for (;;) {
+	if (rcv_done_ < header_size) {
+	    if (auto iores = recv_header(port); !iores) {
+		return iores;
+	    }
+	    if (auto res = setup_iov_base(storage_, iov_); !res) {
+		rcv_done_ = 0;
+		return io_result::error(port, std::move(res));
+	    }
+	}
+
+	// build iovec for rest of current message from rcv_done_
+	::iovec iov[N];
+	int ioc = 0;
+	size_t skip = rcv_done_ - header_size;
+	for (int i = 1; i <= N; i++) {
+	    auto n = iov_[i].iov_len;
+	    if (skip >= n) {
+		skip -= n;
+		continue;
+	    }
+	    iov[ioc].iov_base = static_cast<char*>(iov_[i].iov_base) + skip;
+	    iov[ioc].iov_len  = n - skip;
+	    skip = 0;
+	    ioc++;
+	}
+	if (ioc == 0) {
+	    rcv_done_ = 0;
+	    return io_result::ok();
+	}
+
+	::iovec *iovp = iov;
+	auto iores = port.read_v(iovp, ioc);
+	rcv_done_ += iores.get_done();
+	if (!iores) {
+	    return recv_failed(port, iores);
+	}
+    }
+}
+
+// read header incrementally, and setup header and size of parts.
+template <typename Header, int N>
+template <typename Port>
+io_result
+multipart_msgbuf<Header, N>::recv_header(Port& port)
+{
+    constexpr size_t header_size = sizeof(internal_header);
+
+    while (rcv_done_ < header_size) {
+	::iovec iov[1] = {{ reinterpret_cast<char*>(&rcv_header_) + rcv_done_,
+			    header_size - rcv_done_ }};
+	::iovec *iovp = iov;
+	int ioc = 1;
+	auto iores = port.read_v(iovp, ioc);
+	rcv_done_ += iores.get_done();
+	if (!iores) {
+	    return recv_failed(port, iores);
+	}
+    }
+
+    this->header = rcv_header_.header;
+    if (port.is_different_endian()) {
+	for (auto& v: rcv_header_.size) {
+	    c7::endian::reverse(v);
+	}
+    }
+    setup_iov_len(rcv_header_, iov_);
+    return io_result::ok();
+}
+
+// BUSY: keep state to continue on next call, others: reset state.
+template <typename Header, int N>
+template <typename Port>
+io_result
+multipart_msgbuf<Header, N>::recv_failed(Port& port, io_result& iores)
+{
+    auto status = iores.get_status();
+    if (status == io_result::status::BUSY) {
+	return std::move(iores);		// incomplete: continue on next call
+    }
+    auto done = rcv_done_;
+    rcv_done_ = 0;
+    if (status == io_result::status::CLOSED && done != 0) {
+	return io_result::incomp(port, done, iores.get_remain());
+    }
+    return std::move(iores);
+}
+
+template <typename Header, int N>
+template <typename Port>
+io_result
+multipart_msgbuf<Header, N>::recv_n(Port& port)
 {
     internal_header header;
 
@@ -152,6 +276,244 @@ multipart_msgbuf<Header, N>::recv(Port& port)
     return io_result::ok();
 }
 
+template <typename Header, int N>
+template <typename InPort, typename OutPort>
+io_result
+multipart_msgbuf<Header, N>::relay(InPort& in, OutPort& out, splice_pipe& pipe)
+{
+    if (rly_state_ == relay_state::HEADER) {
+	if (auto iores = recv_header(in); !iores) {
+	    return iores;
+	}
+	rcv_done_ = 0;
+	size_t total = 0;
+	for (int i = 1; i <= N; i++) {
+	    total += iov_[i].iov_len;
+	}
+
+	// parts are received into user space and sent by send() if ports cannot be
+	// spliced or data queued in out must be sent ahead of this message.
+	bool copy = !(splice_traits<InPort>::spliceable && splice_traits<OutPort>::spliceable);
+	if constexpr (has_send_queued_v<OutPort>) {
+	    copy = copy || (out.send_queued() != 0);	// C7_EVENT_PORT_SEND_QUEUE
+	}
+	if (!copy) {
+	    // blocking in: parts are streamed to out as they arrive.
+	    bool nonblocking = splice_pipe::is_nonblocking(in.fd_number());
+	    if constexpr (has_is_nonblocking_read_v<InPort>) {
+		nonblocking = nonblocking || in.is_nonblocking_read();	// set by receiver
+	    }
+	    if (!nonblocking) {
+		return relay_stream(in, out, pipe, total);
+	    }
+	    if (pipe.capacity() == 0) {
+		if (auto res = pipe.init(); !res) {
+		    return io_result::error(in, std::move(res));
+		}
+	    }
+	    // non-blocking in: parts which cannot be held in the pipe are received
+	    // into user space not to write partial message to out.
+	    copy = (total > pipe.capacity());
+	}
+
+	if (copy) {
+	    if (auto res = setup_iov_base(storage_, iov_); !res) {
+		return io_result::error(in, std::move(res));
+	    }
+	    rcv_done_ = sizeof(internal_header);
+	    rly_state_ = relay_state::COPY;
+	} else {
+	    for (int i = 1; i <= N; i++) {
+		iov_[i].iov_base = nullptr;
+	    }
+	    storage_.reset();
+	    rly_rest_ = total;
+	    rly_state_ = relay_state::SPLICE;
+	}
+    }
+
+    if (rly_state_ == relay_state::SPLICE) {
+	// all parts are collected in the pipe before writing to out.
+	auto iores = relay_fill(in, pipe);
+	if (iores) {
+	    rly_state_ = relay_state::HEADER;
+	    return relay_flush(out, pipe);
+	}
+	if (iores.get_status() != io_result::status::BUSY) {
+	    pipe.discard();
+	    rly_state_ = relay_state::HEADER;
+	    return iores;
+	}
+	if (!splice_pipe::is_readable(in.fd_number())) {
+	    return iores;
+	}
+	// in is readable but the pipe is full: pipe buffers are consumed by small
+	// segments. Data held in the pipe is moved into user space to continue by COPY.
+	if (auto iores = relay_to_copy(in, pipe); !iores) {
+	    rly_state_ = relay_state::HEADER;
+	    return iores;
+	}
+    }
+
+    // relay_state::COPY: rest of parts are received incrementally by recv_v.
+    auto iores = recv_v(in);
+    if (iores.get_status() == io_result::status::BUSY) {
+	return iores;
+    }
+    rly_state_ = relay_state::HEADER;
+    if (!iores) {
+	return iores;
+    }
+    return send(out, this->header);
+}
+
+// move rest of parts from in into the pipe without waiting.
+template <typename Header, int N>
+template <typename InPort>
+io_result
+multipart_msgbuf<Header, N>::relay_fill(InPort& in, splice_pipe& pipe)
+{
+    // C7_EVENT_PORT_RECV_BUFFER: leading part of data may have been read ahead.
+    if constexpr (has_recv_buffered_v<InPort>) {
+	if (size_t n = std::min(in.recv_buffered(), rly_rest_); n > 0) {
+	    char buf[4096];
+	    for (size_t z; n > 0; n -= z, rly_rest_ -= z) {
+		z = std::min(n, sizeof(buf));
+		if (auto iores = in.read_n(buf, z); !iores) {
+		    return iores;
+		}
+		if (auto iores = pipe.fill(buf, z); !iores) {
+		    return iores;
+		}
+	    }
+	}
+    }
+    if (rly_rest_ > 0) {
+	auto iores = pipe.fill(in.fd_number(), rly_rest_);
+	rly_rest_ -= iores.get_done();
+	return iores;
+    }
+    return io_result::ok();
+}
+
+// SPLICE -> COPY: parts held in the pipe are moved into storage.
+template <typename Header, int N>
+template <typename InPort>
+io_result
+multipart_msgbuf<Header, N>::relay_to_copy(InPort& in, splice_pipe& pipe)
+{
+    if (auto res = setup_iov_base(storage_, iov_); !res) {
+	pipe.discard();
+	return io_result::error(in, std::move(res));
+    }
+    size_t held = pipe.held();
+    rcv_done_ = sizeof(internal_header) + held;
+    for (int i = 1; i <= N && held > 0; i++) {
+	size_t z = std::min(held, iov_[i].iov_len);
+	if (auto iores = pipe.drain(iov_[i].iov_base, z); !iores) {
+	    pipe.discard();
+	    rcv_done_ = 0;
+	    return iores;
+	}
+	held -= z;
+    }
+    rly_state_ = relay_state::COPY;
+    return io_result::ok();
+}
+
+// write header and parts held in the pipe to out.
+template <typename Header, int N>
+template <typename OutPort>
+io_result
+multipart_msgbuf<Header, N>::relay_flush(OutPort& out, splice_pipe& pipe)
+{
+    auto header = out_header(out.is_different_endian());
+    auto unlock = lock_traits<OutPort>::lock_ifimpl(out);
+
+    if constexpr (has_send_queued_v<OutPort>) {
+	if (out.has_send_queue()) {
+	    // C7_EVENT_PORT_SEND_QUEUE: out is non-blocking, so data which cannot be
+	    // spliced is moved into the send queue instead of waiting out.
+	    if (auto iores = out.write_n(&header, sizeof(header)); !iores) {
+		pipe.discard();
+		return iores;
+	    }
+	    if (out.send_queued() == 0) {
+		auto iores = pipe.flush(out.fd_number(), false);
+		if (iores.get_status() != io_result::status::BUSY) {
+		    return iores;
+		}
+	    }
+	    size_t n = pipe.held();
+	    auto buf = std::make_unique<char[]>(n);
+	    if (auto iores = pipe.drain(buf.get(), n); !iores) {
+		pipe.discard();
+		return iores;
+	    }
+	    return out.write_n(buf.get(), n);
+	}
+    }
+
+    if (auto iores = splice_pipe::write_all(out.fd_number(), &header, sizeof(header)); !iores) {
+	pipe.discard();
+	return iores;
+    }
+    return pipe.flush(out.fd_number());
+}
+
+// blocking in: header is written to out at first, and parts are moved as they arrive.
+template <typename Header, int N>
+template <typename InPort, typename OutPort>
+io_result
+multipart_msgbuf<Header, N>::relay_stream(InPort& in, OutPort& out, splice_pipe& pipe, size_t total)
+{
+    for (int i = 1; i <= N; i++) {
+	iov_[i].iov_base = nullptr;
+    }
+    storage_.reset();
+
+    auto header = out_header(out.is_different_endian());
+    auto unlock = lock_traits<OutPort>::lock_ifimpl(out);
+    if (auto iores = splice_pipe::write_all(out.fd_number(), &header, sizeof(header)); !iores) {
+	return iores;
+    }
+
+    // C7_EVENT_PORT_RECV_BUFFER: leading part of data may have been read ahead.
+    if constexpr (has_recv_buffered_v<InPort>) {
+	if (size_t n = std::min(in.recv_buffered(), total); n > 0) {
+	    char buf[4096];
+	    for (size_t z; n > 0; n -= z, total -= z) {
+		z = std::min(n, sizeof(buf));
+		if (auto iores = in.read_n(buf, z); !iores) {
+		    return iores;
+		}
+		if (auto iores = splice_pipe::write_all(out.fd_number(), buf, z); !iores) {
+		    return iores;
+		}
+	    }
+	}
+    }
+    if (total > 0) {
+	return pipe.transfer(in.fd_number(), out.fd_number(), total);
+    }
+    return io_result::ok();
+}
+
+template <typename Header, int N>
+auto
+multipart_msgbuf<Header, N>::out_header(bool reverse_endian) const -> internal_header
+{
+    internal_header header;
+    header.header = this->header;
+    for (int i = 1; i <= N; i++) {
+	header.size[i-1] = iov_[i].iov_len;
+	if (reverse_endian) {
+	    c7::endian::reverse(header.size[i-1]);
+	}
+    }
+    return header;
+}
+
 template <typename Header, int N>
 template <typename Port>
 io_result
@@ -193,6 +555,10 @@ template <typename Port>
 result<>
 multipart_msgbuf<Header, N>::send(portgroup<Port>& ports, const Header& h) const
 {
+    if constexpr (has_write_shared_v<Port>) {
+	return send_shared(ports, h);
+    }
+
     ports.clear_errors();
 
     if constexpr (lock_traits<portgroup<Port>>::has_lock) {
@@ -232,6 +598,98 @@ multipart_msgbuf<Header, N>::send(portgroup<Port>& ports, const Header& h) const
     }
 }
 
+template <typename Header, int N>
+template <typename Port>
+result<>
+multipart_msgbuf<Header, N>::send_shared(portgroup<Port>& ports, const Header& h) const
+{
+    // C7_EVENT_PORT_SEND_QUEUE
+    //
+    // Message is serialized only once (for each endian) into immutable shared buffer,
+    // and the buffer is only queued into send queue of each port without copying
+    // and without writing. Queued data is flushed by monitor thread of each port
+    // on EPOLLOUT, so that the flush is spread over the monitor threads.
+    // Ports without send queue are written synchronously on the caller thread as
+    // before. The group lock (if any) is held only while ports are enumerated.
+
+    ports.clear_errors();
+
+    std::shared_ptr<const char> msg[2];		// [0]:same endian, [1]:different endian
+    size_t msg_size = 0;
+
+    auto send_one = [&](Port& port) {
+	if (port.has_send_queue()) {
+	    int k = port.is_different_endian() ? 1 : 0;
+	    if (!msg[k]) {
+		msg[k] = serialize(h, (k == 1), msg_size);
+	    }
+	    auto unlock_port = lock_traits<Port>::lock_ifimpl(port);
+	    return port.write_shared(msg[k], msg[k].get(), msg_size, false);
+	}
+	return send(port, h);
+    };
+
+    if constexpr (lock_traits<portgroup<Port>>::has_lock) {
+	std::vector<Port> targets;
+	{
+	    auto unlock = lock_traits<portgroup<Port>>::lock_ifimpl(ports);
+	    for (auto pp: ports) {
+		targets.push_back(*pp);		// DON'T std::move(*pp)
+	    }
+	}
+	std::vector<std::pair<Port, io_result>> errs;
+	for (auto& port: targets) {
+	    if (auto io_res = send_one(port); !io_res) {
+		errs.emplace_back(std::move(port), std::move(io_res));
+	    }
+	}
+	auto unlock = lock_traits<portgroup<Port>>::lock_ifimpl(ports);
+	for (auto& [port, io_res]: errs) {
+	    ports.add_error(port, std::move(io_res));
+	}
+    } else {
+	for (auto pp: ports) {
+	    if (auto io_res = send_one(*pp); !io_res) {
+		ports.add_error(*pp, std::move(io_res));
+	    }
+	}
+    }
+
+    if (ports) {
+	return c7result_ok();
+    } else {
+	return c7result_err("Error on %{} port(s)", ports.errors().size());
+    }
+}
+
+template <typename Header, int N>
+std::shared_ptr<const char>
+multipart_msgbuf<Header, N>::serialize(const Header& h, bool reverse_endian, size_t& size) const
+{
+    internal_header header;
+    header.header = h;
+    size = sizeof(header);
+    for (int i = 1; i <= N; i++) {
+	header.size[i-1] = iov_[i].iov_len;
+	if (reverse_endian) {
+	    c7::endian::reverse(header.size[i-1]);
+	}
+	size += iov_[i].iov_len;
+    }
+
+    std::shared_ptr<char[]> buf(new char[size]);
+    char *p = buf.get();
+    std::memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    for (int i = 1; i <= N; i++) {
+	if (auto n = iov_[i].iov_len; n > 0) {
+	    std::memcpy(p, iov_[i].iov_base, n);
+	    p += n;
+	}
+    }
+    return std::shared_ptr<const char>(buf, buf.get());
+}
+
 template <typename Header, int N>
 template <typename H2>
 void
@@ -263,6 +721,10 @@ multipart_msgbuf<Header, N>::move_contents(multipart_msgbuf<H2, N>& o)
     std::memset(o.iov_, 0, sizeof(o.iov_));
 
     storage_ = std::move(o.storage_);
+    rcv_done_ = 0;
+    o.rcv_done_ = 0;
+    rly_state_ = relay_state::HEADER;
+    o.rly_state_ = relay_state::HEADER;
 }
 
 template <typename Header, int N>
@@ -276,12 +738,15 @@ multipart_msgbuf<Header, N>::setup_iov_len(const internal_header& h, ::iovec (&i
 
 template <typename Header, int N>
 result<>
-multipart_msgbuf<Header, N>::setup_iov_base(c7::storage& storage, ::iovec (&iov)[N+1])
+multipart_msgbuf<Header, N>::setup_iov_base(pooled_storage& storage, ::iovec (&iov)[N+1])
 {
     size_t new_size = 0;
     for (int i = 1; i <= N; i++) {
 	new_size += c7_align(iov[i].iov_len, part_align_);
     }
+    if (storage.size() < new_size) {
+	storage.reset();		// old contents is not needed
+    }
     if (auto res = storage.reserve(new_size); !res) {
 	return c7result_err(errno, "cannot extend storage: %{}", new_size);
     }
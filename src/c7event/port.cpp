@@ -19,9 +19,13 @@ socket_port::socket_port(c7::socket&& sock): sock_(std::move(sock)) {}
 socket_port::socket_port(int fd): sock_(fd) {}
 
 socket_port::socket_port(socket_port&& o):
-    sock_(std::move(o.sock_)), reverse_endian_(o.reverse_endian_)
+    sock_(std::move(o.sock_)), reverse_endian_(o.reverse_endian_),
+    rd_flags_(std::exchange(o.rd_flags_, 0)), sendq_(std::move(o.sendq_)),
+    send_discarded_(o.send_discarded_), rcvbuf_(std::move(o.rcvbuf_)),
+    on_sendq_(std::move(o.on_sendq_))
 {
     o.reverse_endian_ = false;
+    o.send_discarded_ = 0;
 }
 
 socket_port& socket_port::operator=(socket_port&& o)
@@ -29,6 +33,11 @@ socket_port& socket_port::operator=(socket_port&& o)
     if (this != &o) {
 	sock_ = std::move(o.sock_);
 	reverse_endian_ = o.reverse_endian_;
+	rd_flags_ = std::exchange(o.rd_flags_, 0);
+	sendq_ = std::move(o.sendq_);
+	send_discarded_ = std::exchange(o.send_discarded_, 0);
+	rcvbuf_ = std::move(o.rcvbuf_);
+	on_sendq_ = std::move(o.on_sendq_);
 	o.reverse_endian_ = false;
     }
     return *this;
@@ -75,6 +84,12 @@ result<> socket_port::set_nonblocking(bool enable)
     return sock_.set_nonblocking(enable);
 }
 
+result<> socket_port::set_nonblocking_read(bool enable)
+{
+    rd_flags_ = enable ? MSG_DONTWAIT : 0;
+    return c7result_ok();
+}
+
 result<socket_port> socket_port::accept()
 {
     if (auto res = sock_.accept(); !res) {
@@ -97,16 +112,95 @@ result<> socket_port::connect(const sockaddr_gen& addr)
 
 io_result socket_port::read_n(void *bufaddr, size_t req_n)
 {
+    if (rcvbuf_) {
+	return rcvbuf_->read_n(sock_, bufaddr, req_n, rd_flags_);
+    }
+    if (rd_flags_ != 0) {
+	::iovec iov[1] = {{ bufaddr, req_n }};
+	::iovec *iovp = iov;
+	int ioc = 1;
+	return sock_.recv_v(iovp, ioc, rd_flags_);
+    }
     return sock_.read_n(bufaddr, req_n);
 }
 
+io_result socket_port::read_v(::iovec*& iov_io, int& ioc_io)
+{
+    if (rcvbuf_) {
+	return rcvbuf_->read_v(sock_, iov_io, ioc_io, rd_flags_);
+    }
+    if (rd_flags_ != 0) {
+	return sock_.recv_v(iov_io, ioc_io, rd_flags_);
+    }
+    return sock_.read_v(iov_io, ioc_io);
+}
+
 io_result socket_port::write_v(::iovec*& iov_io, int& ioc_io)
 {
+    if (sendq_) {
+	auto io_res = sendq_->write_v(sock_, iov_io, ioc_io);
+	notify_sendq();
+	return io_res;
+    }
     return sock_.write_v(iov_io, ioc_io);
 }
 
+result<> socket_port::enable_send_queue(size_t high_wm, size_t low_wm)
+{
+    if (auto res = sock_.set_nonblocking(true); !res) {
+	return res;
+    }
+    if (sendq_ == nullptr) {
+	sendq_ = std::make_unique<send_queue>(high_wm, low_wm);
+    }
+    return c7result_ok();
+}
+
+io_result socket_port::flush_sendq()
+{
+    if (sendq_ == nullptr) {
+	return io_result::ok();
+    }
+    auto io_res = sendq_->flush(sock_);
+    notify_sendq();
+    return io_res;
+}
+
+io_result socket_port::write_shared(std::shared_ptr<const void> holder,
+				    const void *data, size_t size, bool direct)
+{
+    if (sendq_ && sock_) {
+	auto io_res = sendq_->write_shared(sock_, std::move(holder), data, size, direct);
+	notify_sendq();
+	return io_res;
+    }
+    return sock_.write_n(data, size);
+}
+
+void socket_port::enable_recv_buffer(size_t capacity)
+{
+    if (rcvbuf_ == nullptr) {
+	rcvbuf_ = std::make_unique<recv_buffer>(capacity);
+    }
+}
+
+void socket_port::notify_sendq()
+{
+    if (sendq_->update_state()) {
+	on_sendq_(sendq_->get_state());
+    }
+}
+
 void socket_port::close()
 {
+    if (sendq_) {
+	send_discarded_ += sendq_->size();
+	sendq_->clear();
+	notify_sendq();
+    }
+    if (rcvbuf_) {
+	rcvbuf_->clear();
+    }
     sock_.close();
 }
 
@@ -117,6 +211,9 @@ void socket_port::print(std::ostream& out, const std::string& spec) const
 
 result<size_t> socket_port::read(void *bufaddr, size_t size)
 {
+    if (rcvbuf_) {
+	return rcvbuf_->read(sock_, bufaddr, size);
+    }
     return sock_.read(bufaddr, size);
 }
 
@@ -127,6 +224,12 @@ result<size_t> socket_port::write(const void *bufaddr, size_t size)
 
 io_result socket_port::write_n(const void *bufaddr, size_t req_n)
 {
+    if (sendq_) {
+	::iovec iov[1] = {{ const_cast<void*>(bufaddr), req_n }};
+	::iovec *iovp = iov;
+	int ioc = 1;
+	return write_v(iovp, ioc);
+    }
     return sock_.write_n(bufaddr, req_n);
 }
 
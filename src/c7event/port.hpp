@@ -14,10 +14,17 @@
 #include <c7common.hpp>
 
 
+#include <c7event/recvbuf.hpp>
+#include <c7event/sendq.hpp>
+#include <c7event/traits.hpp>
 #include <c7socket.hpp>
 #include <variant>
 
 
+#define C7_EVENT_PORT_SEND_QUEUE	(1U)
+#define C7_EVENT_PORT_RECV_BUFFER	(1U)
+
+
 namespace c7::event {
 
 
@@ -54,6 +61,7 @@ struct port_rw_extention {
 class socket_port: public port_rw_extention<socket_port> {
 public:
     using delegate_id = delegate_base::id;
+    using sendq_state = send_queue::state;
 
     using port_rw_extention<socket_port>::read;
     using port_rw_extention<socket_port>::read_n;
@@ -91,6 +99,14 @@ public:
     // connector
     result<> set_nonblocking(bool enable);
 
+    // receiver
+    //
+    // read_n/read_v return BUSY instead of waiting data (recvmsg with MSG_DONTWAIT),
+    // while other I/O remains blocking unless set_nonblocking() is called. Incomplete
+    // message is resumed by multipart_msgbuf::recv on next EPOLLIN.
+    result<> set_nonblocking_read(bool enable);
+    bool is_nonblocking_read() const { return rd_flags_ != 0; }
+
     // acceptor
     result<socket_port> accept();
 
@@ -112,9 +128,44 @@ public:
     // multipart_msgbuf
     io_result read_n(void *bufaddr, size_t req_n);
 
+    // multipart_msgbuf
+    io_result read_v(::iovec*& iov_io, int& ioc_io);
+
     // multipart_msgbuf
     io_result write_v(::iovec*& iov_io, int& ioc_io);
 
+    // C7_EVENT_PORT_SEND_QUEUE
+    //
+    // After enable_send_queue() is called, port is changed to non-blocking mode and
+    // write_v/write_n never block: data which cannot be written immediately is
+    // queued and flushed by receiver on EPOLLOUT. Functions registered by
+    // add_on_sendq are called when state of the queue is changed, and receiver
+    // use it to wait EPOLLOUT and to pause reading while state is FULL.
+    // close() discards queued data: the amount is kept in send_discarded(), and
+    // receiver reports it by service::on_error (ECONNABORTED).
+    result<> enable_send_queue(size_t high_wm = send_queue::default_high_watermark,
+			       size_t low_wm = send_queue::default_low_watermark);
+    bool has_send_queue() const { return sendq_ != nullptr; }
+    size_t send_queued() const { return sendq_ ? sendq_->size() : 0; }
+    size_t send_discarded() const { return send_discarded_; }	// bytes dropped by close()
+    io_result flush_sendq();
+    io_result write_shared(std::shared_ptr<const void> holder, const void *data, size_t size,
+			   bool direct = true);
+    delegate_id add_on_sendq(std::function<void(sendq_state)> func) {
+	return on_sendq_.push_back(std::move(func));
+    }
+    void remove_on_sendq(delegate_id id) {
+	on_sendq_.remove(id);
+    }
+
+    // C7_EVENT_PORT_RECV_BUFFER
+    //
+    // After enable_recv_buffer() is called, read_v/read_n/read read data ahead into
+    // the buffer, so that receiver can dispatch pipelined messages without waiting
+    // next EPOLLIN while recv_buffered() is not zero.
+    void enable_recv_buffer(size_t capacity = recv_buffer::default_capacity);
+    size_t recv_buffered() const { return rcvbuf_ ? rcvbuf_->size() : 0; }
+
     // formattable
     void print(std::ostream& out, const std::string& spec) const;
 
@@ -138,6 +189,19 @@ public:
 private:
     c7::socket sock_;
     bool reverse_endian_ = false;
+    int rd_flags_ = 0;			// flags of recvmsg in read_n/read_v
+    std::unique_ptr<send_queue> sendq_;
+    size_t send_discarded_ = 0;
+    std::unique_ptr<recv_buffer> rcvbuf_;
+    c7::delegate<void, sendq_state> on_sendq_;
+
+    void notify_sendq();
+};
+
+
+template <>
+struct receiver_traits<socket_port> {
+    static inline constexpr bool nonblocking_read = true;
 };
 
 
@@ -17,6 +17,8 @@
 #include <c7event/monitor.hpp>
 #include <c7event/port.hpp>
 #include <c7event/service.hpp>
+#include <c7format.hpp>
+#include <atomic>
 
 
 namespace c7::event {
@@ -28,6 +30,18 @@ public:
     using service_base = service_interface<Msgbuf, Port>;
     using service_ptr  = shared_service_ptr<Msgbuf, Port>;
 
+    struct stats_t {
+	uint64_t n_event;	// # of EPOLLIN events
+	uint64_t n_message;	// # of messages dispatched to on_message
+	uint64_t n_budget_out;	// # of events which reached message budget
+	uint64_t max_batch;	// maximum # of messages dispatched by one event
+
+	void print(std::ostream& out, const std::string&) const {
+	    c7::format(out, "event:%{}, message:%{}, budget_out:%{}, max_batch:%{}",
+		       n_event, n_message, n_budget_out, max_batch);
+	}
+    };
+
     ~receiver() override {}
     int fd() override;
     void on_manage(monitor& mon, int prvfd) override;
@@ -39,11 +53,23 @@ public:
 	return std::shared_ptr<receiver>(p);
     }
 
+    // maximum number of messages dispatched by one event (default: 64)
+    // This works if Port has receive buffer (C7_EVENT_PORT_RECV_BUFFER), and rest of
+    // buffered messages are dispatched after other providers are served.
+    void set_message_budget(int n) { budget_ = std::max(n, 1); }
+
+    const stats_t& stats() const { return stats_; }
+
 private:
     Port port_;
     service_ptr svc_;
     Msgbuf msgbuf_;
     provider_hint hint_;
+    delegate_base::id sendq_id_;
+    std::atomic<bool> sendq_full_ = false;	// written by sendq callback (any thread)
+    std::atomic<bool> sendq_paused_in_ = false;	// EPOLLIN was removed while FULL
+    int budget_ = 64;
+    stats_t stats_ = {};
 
     receiver(Port&& port, service_ptr&&, provider_hint hint);
 };
@@ -15,11 +15,16 @@
 
 
 #include <c7event/receiver.hpp>
+#include <c7event/traits.hpp>
+#include <c7typefunc.hpp>
 
 
 namespace c7::event {
 
 
+c7typefunc_define_has_member(add_on_sendq);
+
+
 // implementation of receiver
 
 
@@ -41,40 +46,125 @@ template <typename Msgbuf, typename Port>
 void receiver<Msgbuf, Port>::on_manage(monitor& mon, int prvfd)
 {
     port_.add_on_close([&mon, prvfd](){ mon.unmanage(prvfd); });
+    if constexpr (receiver_traits<Port>::nonblocking_read) {
+	// incomplete message is resumed on next EPOLLIN instead of parking monitor thread.
+	(void)port_.set_nonblocking_read(true);
+    }
+    if constexpr (has_add_on_sendq_v<Port>) {
+	// C7_EVENT_PORT_SEND_QUEUE: wait EPOLLOUT while data is queued, and
+	//                           pause reading while queue is FULL.
+	// This may be called on any thread which writes to port, so events are
+	// modified relative to current ones (those set by user are kept).
+	sendq_id_ = port_.add_on_sendq(
+	    [this, &mon, prvfd](send_queue::state state) {
+		bool full = (state == send_queue::state::FULL);
+		bool resumed = (sendq_full_.exchange(full) && !full);
+		if (full) {
+		    auto res = mon.modify_event(prvfd, EPOLLOUT, EPOLLIN);
+		    if (res && (res.value() & EPOLLIN) != 0) {
+			sendq_paused_in_ = true;
+		    }
+		} else {
+		    uint32_t on = sendq_paused_in_.exchange(false) ? EPOLLIN : 0;
+		    if (state == send_queue::state::PENDING) {
+			(void)mon.modify_event(prvfd, on|EPOLLOUT, 0);
+		    } else {
+			(void)mon.modify_event(prvfd, on, EPOLLOUT);
+		    }
+		}
+		if constexpr (has_recv_buffered_v<Port>) {
+		    if (resumed && port_.recv_buffered() != 0) {
+			mon.post_event(prvfd, EPOLLIN);
+		    }
+		}
+	    });
+    }
     svc_->on_attached(mon, port_, hint_);
 }
 
 
 template <typename Msgbuf, typename Port>
-void receiver<Msgbuf, Port>::on_event(monitor& mon, int, uint32_t events)
+void receiver<Msgbuf, Port>::on_event(monitor& mon, int prvfd, uint32_t events)
 {
     if ((events & EPOLLOUT) != 0) {
+	if constexpr (has_add_on_sendq_v<Port>) {
+	    io_result io_res;
+	    {
+		auto unlock = lock_traits<Port>::lock_ifimpl(port_);
+		io_res = port_.flush_sendq();
+	    }
+	    if (!io_res && io_res.get_status() != io_result::status::BUSY) {
+		svc_->on_error(mon, port_, io_res);
+		if (port_.is_alive()) {
+		    port_.close();
+		}
+		return;
+	    }
+	}
 	svc_->on_sendable(mon, port_);
     }
 
     if ((events & EPOLLIN) == 0) {
 	return;
     }
-    auto io_res = msgbuf_.recv(port_);
-    if (io_res.get_status() == io_result::status::OK) {
-	svc_->on_message(mon, port_, msgbuf_);
-    } else if (io_res.get_status() == io_result::status::CLOSED) {
-	svc_->on_disconnected(mon, port_, io_res);
-	if (port_.is_alive()) {
-	    port_.close();
+    stats_.n_event++;
+
+    // C7_EVENT_PORT_RECV_BUFFER: dispatch messages which have been already read into
+    // the receive buffer of port up to budget_ without waiting next EPOLLIN.
+    uint64_t n_msg = 0;
+    for (;;) {
+	auto io_res = msgbuf_.recv(port_);
+	if (io_res.get_status() == io_result::status::OK) {
+	    n_msg++;
+	    svc_->on_message(mon, port_, msgbuf_);
+	} else if (io_res.get_status() == io_result::status::BUSY) {
+	    // non-blocking port: message is incomplete, rest is read on next EPOLLIN.
+	    break;
+	} else if (io_res.get_status() == io_result::status::CLOSED) {
+	    svc_->on_disconnected(mon, port_, io_res);
+	    if (port_.is_alive()) {
+		port_.close();
+	    }
+	    break;
+	} else {
+	    svc_->on_error(mon, port_, io_res);
+	    if (port_.is_alive()) {
+		port_.close();
+	    }
+	    break;
 	}
-    } else {
-	svc_->on_error(mon, port_, io_res);
-	if (port_.is_alive()) {
-	    port_.close();
+
+	if constexpr (has_recv_buffered_v<Port>) {
+	    if (!port_.is_alive() || sendq_full_ || port_.recv_buffered() == 0) {
+		break;
+	    }
+	    if (n_msg >= uint64_t(budget_)) {
+		// yield to other providers, and continue on next iteration of loop.
+		stats_.n_budget_out++;
+		mon.post_event(prvfd, EPOLLIN);
+		break;
+	    }
+	} else {
+	    break;
 	}
     }
+    stats_.n_message += n_msg;
+    stats_.max_batch = std::max(stats_.max_batch, n_msg);
 }
 
 
 template <typename Msgbuf, typename Port>
 void receiver<Msgbuf, Port>::on_unmanage(monitor& mon, int)
 {
+    if constexpr (has_add_on_sendq_v<Port>) {
+	port_.remove_on_sendq(sendq_id_);
+	if (auto n = port_.send_discarded(); n != 0) {
+	    io_result io_res(io_result::status::ERR, 0, n,
+			     c7result_err(ECONNABORTED,
+					  "%{} bytes in send queue were discarded by close", n));
+	    svc_->on_error(mon, port_, io_res);
+	}
+    }
     svc_->on_detached(mon, port_, hint_);
 }
 
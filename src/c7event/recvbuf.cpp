@@ -0,0 +1,159 @@
+/*
+ * c7event/recvbuf.cpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ */
+
+
+#include <c7event/recvbuf.hpp>
+#include <c7format.hpp>
+#include <cstring>
+#include <sys/socket.h>
+
+
+namespace c7::event {
+
+
+recv_buffer::recv_buffer(size_t capacity):
+    buf_(new char[capacity]), cap_(capacity)
+{
+}
+
+
+// copy buffered data to iov, and update iov and ioc.
+size_t
+recv_buffer::take(::iovec*& iov, int& ioc)
+{
+    size_t n = 0;
+    while (ioc > 0 && beg_ < end_) {
+	size_t z = std::min(iov->iov_len, end_ - beg_);
+	std::memcpy(iov->iov_base, buf_.get() + beg_, z);
+	beg_ += z;
+	n += z;
+	if (iov->iov_len == z) {
+	    iov->iov_len = 0;
+	    iov->iov_base = nullptr;
+	    iov++;
+	    ioc--;
+	} else {
+	    iov->iov_len -= z;
+	    iov->iov_base = static_cast<char*>(iov->iov_base) + z;
+	}
+    }
+    if (beg_ == end_) {
+	beg_ = end_ = 0;
+    }
+    return n;
+}
+
+
+io_result
+recv_buffer::read_v(c7::fd& fd, ::iovec*& iov, int& ioc, int flags)
+{
+    size_t n = 0;	// actual read bytes
+
+    for (;;) {
+	n += take(iov, ioc);
+	while (ioc > 0 && iov->iov_len == 0) {
+	    ioc--;
+	    iov++;
+	}
+	if (ioc == 0) {
+	    break;
+	}
+
+	// buffer is empty here: read rest of request and following data at once.
+	::iovec tmp[max_iov + 1];
+	int k = std::min(ioc, max_iov);
+	size_t req = 0;
+	for (int i = 0; i < k; i++) {
+	    tmp[i] = iov[i];
+	    req += iov[i].iov_len;
+	}
+	tmp[k].iov_base = buf_.get();
+	tmp[k].iov_len  = cap_;
+
+	ssize_t z;
+	if (flags == 0) {
+	    z = ::readv(int(fd), tmp, k + 1);
+	} else {
+	    ::msghdr msg {};
+	    msg.msg_iov = tmp;
+	    msg.msg_iovlen = k + 1;
+	    z = ::recvmsg(int(fd), &msg, flags);
+	}
+	if (z <= 0) {
+	    size_t remain = 0;
+	    for (int i = 0; i < ioc; i++) {
+		remain += iov[i].iov_len;
+	    }
+	    auto status = io_result::status::ERR;
+	    const char *descrip = "error";
+
+	    if (z == 0 && n == 0) {
+		status = io_result::status::CLOSED;
+		descrip = "maybe closed";
+		errno = ENODATA;
+	    } else if (z == 0) {
+		status = io_result::status::INCOMP;
+		descrip = "maybe closed";
+		errno = ENODATA;
+	    } else if (errno == EWOULDBLOCK) {
+		status = io_result::status::BUSY;
+		descrip = "busy";
+	    }
+	    return io_result(status, n, remain,
+			     c7result_err(errno,
+					  "read_v(%{}) -> %{} (%{})", fd, n, descrip));
+	}
+
+	if (size_t(z) > req) {		// read-ahead data is stored in buf_
+	    end_ = z - req;
+	    z = req;
+	}
+	n += z;
+	while (z > 0) {
+	    if (iov->iov_len <= (size_t)z) {
+		z -= iov->iov_len;
+		iov->iov_len = 0;
+		iov->iov_base = nullptr;
+		iov++;
+		ioc--;
+	    } else {
+		iov->iov_len -= z;
+		iov->iov_base = static_cast<char*>(iov->iov_base) + z;
+		break;
+	    }
+	}
+    }
+    return io_result::ok(n);
+}
+
+
+io_result
+recv_buffer::read_n(c7::fd& fd, void *bufaddr, size_t req_n, int flags)
+{
+    ::iovec iov[1] = {{ bufaddr, req_n }};
+    ::iovec *iovp = iov;
+    int ioc = 1;
+    return read_v(fd, iovp, ioc, flags);
+}
+
+
+result<size_t>
+recv_buffer::read(c7::fd& fd, void *bufaddr, size_t size)
+{
+    if (!empty()) {
+	::iovec iov[1] = {{ bufaddr, size }};
+	::iovec *iovp = iov;
+	int ioc = 1;
+	return c7result_ok(take(iovp, ioc));
+    }
+    return fd.read(bufaddr, size);
+}
+
+
+} // namespace c7::event
@@ -0,0 +1,68 @@
+/*
+ * c7event/recvbuf.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google document:
+ * https://docs.google.com/document/d/1_2Pj_MDBpX0PwGYouK46sXM1qWyUOi8iUv1zynuXqA0/edit?usp=sharing
+ */
+#ifndef C7_EVENT_RECVBUF_HPP_LOADED_
+#define C7_EVENT_RECVBUF_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7fd.hpp>
+#include <memory>
+
+
+namespace c7::event {
+
+
+// inbound read-ahead buffer of port
+// ---------------------------------
+//
+// - read_v() copies buffered data at first, and then reads rest of request and
+//   following data (up to capacity of buffer) by one readv.
+// - small pipelined messages are received by one system call, and size() tells
+//   receiver whether more data is already buffered.
+
+class recv_buffer {
+public:
+    static constexpr size_t default_capacity = 64 * 1024;
+
+    recv_buffer(const recv_buffer&) = delete;
+    recv_buffer& operator=(const recv_buffer&) = delete;
+
+    explicit recv_buffer(size_t capacity = default_capacity);
+
+    // flags: if not 0, fd must be socket and it is read by recvmsg(2) with flags.
+    io_result read_v(c7::fd& fd, ::iovec*& iov_io, int& ioc_io, int flags = 0);
+    io_result read_n(c7::fd& fd, void *bufaddr, size_t req_n, int flags = 0);
+
+    // read at most size bytes (at most one system call)
+    result<size_t> read(c7::fd& fd, void *bufaddr, size_t size);
+
+    void clear() { beg_ = end_ = 0; }
+
+    size_t size() const { return end_ - beg_; }
+    bool empty() const { return beg_ == end_; }
+
+private:
+    std::unique_ptr<char[]> buf_;
+    size_t cap_;
+    size_t beg_ = 0;
+    size_t end_ = 0;
+
+    static constexpr int max_iov = 64;
+
+    size_t take(::iovec*& iov, int& ioc);
+};
+
+
+} // namespace c7::event
+
+
+#endif // c7event/recvbuf.hpp
@@ -0,0 +1,180 @@
+/*
+ * c7event/sendq.cpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ */
+
+
+#include <c7event/sendq.hpp>
+#include <c7format.hpp>
+#include <cstring>
+
+
+namespace c7::event {
+
+
+send_queue::send_queue(size_t high_wm, size_t low_wm):
+    high_wm_(high_wm), low_wm_(std::min(low_wm, high_wm))
+{
+}
+
+
+io_result
+send_queue::write_v(c7::fd& fd, ::iovec*& iov, int& ioc)
+{
+    size_t done = 0;
+    if (queued_ == 0) {
+	auto io_res = fd.write_v(iov, ioc);
+	if (io_res || io_res.get_status() != io_result::status::BUSY) {
+	    return io_res;
+	}
+	done = io_res.get_done();
+    }
+
+    // [CAUTION] fd.write_v has updated iov and ioc to rest of data.
+    for (; ioc > 0; ioc--, iov++) {
+	append(iov->iov_base, iov->iov_len);
+	done += iov->iov_len;
+	iov->iov_base = nullptr;
+	iov->iov_len = 0;
+    }
+    return io_result::ok(done);
+}
+
+
+io_result
+send_queue::write_shared(c7::fd& fd, std::shared_ptr<const void> holder,
+			 const void *data, size_t size, bool direct)
+{
+    size_t done = 0;
+    if (queued_ == 0 && direct) {
+	auto io_res = fd.write_n(data, size);
+	if (io_res || io_res.get_status() != io_result::status::BUSY) {
+	    return io_res;
+	}
+	done = io_res.get_done();
+    }
+    if (size > done) {
+	chunks_.push_back(chunk{std::move(holder),
+				static_cast<const char*>(data) + done, size - done, 0});
+	queued_ += size - done;
+    }
+    return io_result::ok(size);
+}
+
+
+io_result
+send_queue::flush(c7::fd& fd)
+{
+    size_t n = 0;	// actual written bytes
+
+    while (!chunks_.empty()) {
+	::iovec iov[max_iov];
+	int ioc = 0;
+	for (auto& c: chunks_) {
+	    if (ioc == max_iov) {
+		break;
+	    }
+	    iov[ioc].iov_base = const_cast<char*>(c.data);
+	    iov[ioc].iov_len  = c.size;
+	    ioc++;
+	}
+
+	ssize_t z = ::writev(fd, iov, ioc);
+	if (z <= 0) {
+	    if (errno == EWOULDBLOCK) {
+		return io_result(io_result::status::BUSY, n, queued_,
+				 c7result_err(errno, "send_queue::flush(%{}) (busy)", fd));
+	    } else {
+		return io_result(io_result::status::ERR, n, queued_,
+				 c7result_err(errno, "send_queue::flush(%{}) (error)", fd));
+	    }
+	}
+	n += z;
+	queued_ -= z;
+	while (z > 0) {
+	    auto& c = chunks_.front();
+	    if (c.size <= (size_t)z) {
+		z -= c.size;
+		chunks_.pop_front();
+	    } else {
+		c.data += z;
+		c.size -= z;
+		break;
+	    }
+	}
+    }
+    return io_result::ok(n);
+}
+
+
+void
+send_queue::clear()
+{
+    chunks_.clear();
+    queued_ = 0;
+}
+
+
+bool
+send_queue::update_state()
+{
+    auto old_state = state_;
+    if (queued_ == 0) {
+	state_ = state::IDLE;
+    } else if (queued_ >= high_wm_) {
+	state_ = state::FULL;
+    } else if (state_ != state::FULL || queued_ <= low_wm_) {
+	state_ = state::PENDING;
+    }
+    return (old_state != state_);
+}
+
+
+void
+send_queue::append(const void *data, size_t size)
+{
+    if (size == 0) {
+	return;
+    }
+    if (!chunks_.empty()) {
+	if (auto& c = chunks_.back(); c.room >= size) {
+	    std::memcpy(const_cast<char*>(c.data) + c.size, data, size);
+	    c.size += size;
+	    c.room -= size;
+	    queued_ += size;
+	    return;
+	}
+    }
+    auto cap = std::max(size, own_chunk_size);
+    std::shared_ptr<char[]> buf(new char[cap]);
+    std::memcpy(buf.get(), data, size);
+    auto addr = buf.get();
+    chunks_.push_back(chunk{std::move(buf), addr, size, cap - size});
+    queued_ += size;
+}
+
+
+void print_type(std::ostream& out, const std::string& format, send_queue::state arg)
+{
+    switch (arg) {
+    case send_queue::state::IDLE:
+	out << "IDLE";
+	break;
+    case send_queue::state::PENDING:
+	out << "PENDING";
+	break;
+    case send_queue::state::FULL:
+	out << "FULL";
+	break;
+    default:
+	out << static_cast<int>(arg);
+	break;
+    }
+}
+
+
+} // namespace c7::event
@@ -0,0 +1,96 @@
+/*
+ * c7event/sendq.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google document:
+ * https://docs.google.com/document/d/1_2Pj_MDBpX0PwGYouK46sXM1qWyUOi8iUv1zynuXqA0/edit?usp=sharing
+ */
+#ifndef C7_EVENT_SENDQ_HPP_LOADED_
+#define C7_EVENT_SENDQ_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7fd.hpp>
+#include <deque>
+#include <memory>
+
+
+namespace c7::event {
+
+
+// outbound queue of port
+// ----------------------
+//
+// - write_v() writes data directly while queue is empty, and enqueue the rest which
+//   could not be written without blocking (the descriptor must be non-blocking).
+// - flush() writes queued chunks with writev as much as possible. It should be
+//   called when the descriptor become writable (EPOLLOUT).
+// - get_state() is changed by queued bytes with hysteresis of watermarks.
+
+class send_queue {
+public:
+    enum class state {
+	IDLE,		// queue is empty
+	PENDING,	// queue has data to be flushed
+	FULL,		// queued bytes reached high watermark (until it fall to low watermark)
+    };
+
+    static constexpr size_t default_high_watermark = 4 * 1024 * 1024;
+    static constexpr size_t default_low_watermark  = 1 * 1024 * 1024;
+
+    send_queue(const send_queue&) = delete;
+    send_queue& operator=(const send_queue&) = delete;
+
+    explicit send_queue(size_t high_wm = default_high_watermark,
+			size_t low_wm = default_low_watermark);
+
+    io_result write_v(c7::fd& fd, ::iovec*& iov_io, int& ioc_io);
+
+    // enqueue immutable shared data without copying (data must be kept by holder).
+    // If direct is false, data is always queued without trying to write, so that
+    // it is written by flush() on the thread which handle EPOLLOUT of fd.
+    io_result write_shared(c7::fd& fd, std::shared_ptr<const void> holder,
+			   const void *data, size_t size, bool direct = true);
+
+    io_result flush(c7::fd& fd);
+
+    void clear();
+
+    size_t size() const { return queued_; }
+    bool empty() const { return queued_ == 0; }
+    state get_state() const { return state_; }
+
+    // return true if state is changed from last call of this function.
+    bool update_state();
+
+private:
+    struct chunk {
+	std::shared_ptr<const void> holder;
+	const char *data;
+	size_t size;
+	size_t room;		// appendable bytes after data+size (only for own buffer)
+    };
+
+    static constexpr size_t own_chunk_size = 16 * 1024;
+    static constexpr int max_iov = 64;
+
+    std::deque<chunk> chunks_;
+    size_t queued_ = 0;
+    size_t high_wm_;
+    size_t low_wm_;
+    state state_ = state::IDLE;
+
+    void append(const void *data, size_t size);
+};
+
+void print_type(std::ostream& out, const std::string& format, send_queue::state arg);
+
+
+} // namespace c7::event
+
+
+#endif // c7event/sendq.hpp
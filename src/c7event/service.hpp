@@ -145,6 +145,8 @@ public:
     virtual detach_id on_detached(monitor&, port_type&, provider_hint) { return detach_id(); }
 
     // case: port is sendable
+    //       If send queue of port is enabled, queued data has been flushed as much
+    //       as possible before this call.
     virtual void on_sendable(monitor&, port_type&) {}
 
     // case: Msgbuf::recv() return io_result::status::OK
@@ -155,7 +157,8 @@ public:
     //       receiver call Port::close.
     virtual void on_disconnected(monitor&, port_type&, io_result&) {}
 
-    // case: Msgbuf::recv() return others
+    // case: Msgbuf::recv() return others except io_result::status::BUSY
+    //       (BUSY means that the message is incomplete on non-blocking port)
     //       If Port object is alive when returned from on_disconnect,
     //       receiver call Port::close.
     virtual void on_error(monitor&, port_type&, io_result&) {}
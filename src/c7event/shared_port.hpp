@@ -100,6 +100,14 @@ public:
 	return pimpl_->port.set_nonblocking(enable);
     }
 
+    // receiver
+    result<> set_nonblocking_read(bool enable) {
+	return pimpl_->port.set_nonblocking_read(enable);
+    }
+    bool is_nonblocking_read() const {
+	return pimpl_->port.is_nonblocking_read();
+    }
+
     // acceptor
     result<shared_port> accept();
 
@@ -133,11 +141,52 @@ public:
 	return pimpl_->port.read_n(bufaddr, req_n);
     }
 
+    // multipart_msgbuf
+    io_result read_v(::iovec*& iov_io, int& ioc_io) {
+	return pimpl_->port.read_v(iov_io, ioc_io);
+    }
+
     // multipart_msgbuf
     io_result write_v(::iovec*& iov_io, int& ioc_io) {
 	return pimpl_->port.write_v(iov_io, ioc_io);
     }
 
+    // C7_EVENT_PORT_SEND_QUEUE
+    result<> enable_send_queue(size_t high_wm = send_queue::default_high_watermark,
+			       size_t low_wm = send_queue::default_low_watermark) {
+	return pimpl_->port.enable_send_queue(high_wm, low_wm);
+    }
+    bool has_send_queue() const {
+	return pimpl_->port.has_send_queue();
+    }
+    size_t send_queued() const {
+	return pimpl_->port.send_queued();
+    }
+    size_t send_discarded() const {
+	return pimpl_->port.send_discarded();
+    }
+    io_result flush_sendq() {
+	return pimpl_->port.flush_sendq();
+    }
+    io_result write_shared(std::shared_ptr<const void> holder, const void *data, size_t size,
+			   bool direct = true) {
+	return pimpl_->port.write_shared(std::move(holder), data, size, direct);
+    }
+    delegate_id add_on_sendq(std::function<void(socket_port::sendq_state)> func) {
+	return pimpl_->port.add_on_sendq(std::move(func));
+    }
+    void remove_on_sendq(delegate_id id) {
+	pimpl_->port.remove_on_sendq(id);
+    }
+
+    // C7_EVENT_PORT_RECV_BUFFER
+    void enable_recv_buffer(size_t capacity = recv_buffer::default_capacity) {
+	pimpl_->port.enable_recv_buffer(capacity);
+    }
+    size_t recv_buffered() const {
+	return pimpl_->port.recv_buffered();
+    }
+
     // formattable
     void print(std::ostream& out, const std::string&) const;
 
@@ -262,6 +311,12 @@ struct lock_traits<shared_port> {
 };
 
 
+template <>
+struct receiver_traits<shared_port> {
+    static inline constexpr bool nonblocking_read = true;
+};
+
+
 } // namespace c7::event
 
 
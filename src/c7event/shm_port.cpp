@@ -0,0 +1,622 @@
+/*
+ * c7event/shm_port.cpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ */
+
+
+#include <c7event/shm_port.hpp>
+#include <c7format.hpp>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+namespace c7::event {
+
+
+/*----------------------------------------------------------------------------
+                              shared memory layout
+----------------------------------------------------------------------------*/
+
+namespace {
+
+constexpr uint64_t shm_magic = 0x63377368'6d706f73;	// "c7shmpos"
+
+// SPSC byte ring: written by one side and read by the other side.
+struct shm_ring {
+    alignas(64) std::atomic<uint64_t> wpos;
+    alignas(64) std::atomic<uint64_t> rpos;
+    alignas(64) std::atomic<uint32_t> rd_waiting;	// reader is going to sleep
+    std::atomic<uint32_t> wr_waiting;			// writer is going to sleep
+};
+
+struct shm_segment {
+    uint64_t magic;
+    uint64_t capacity;
+    std::atomic<uint32_t> alive[2];
+    std::atomic<int32_t> pid[2];	// process which has side i
+    shm_ring ring[2];			// ring[i] is written by side i
+};
+
+constexpr size_t data_offset = c7_align(sizeof(shm_segment), 4096);
+
+enum { DATA_BELL, SPACE_BELL };
+
+void ring_bell(c7::fd& bell)
+{
+    uint64_t v = 1;
+    (void)::write(bell, &v, sizeof(v));
+}
+
+void drain_bell(c7::fd& bell)
+{
+    uint64_t v;
+    (void)::read(bell, &v, sizeof(v));		// bell is non-blocking
+}
+
+result<c7::fd> dup_fd(int fd)
+{
+    int newfd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (newfd == C7_SYSERR) {
+	return c7result_err(errno, "fcntl(%{}, F_DUPFD_CLOEXEC) failed", fd);
+    }
+    return c7result_ok(c7::fd(newfd));
+}
+
+// pidfd of peer process is also waited, because peer which died without close()
+// never rings the doorbell.
+void wait_bell(c7::fd& bell, c7::fd& peer_pidfd)
+{
+    ::pollfd pfd[2] = {{ bell, POLLIN, 0 }, { peer_pidfd, POLLIN, 0 }};
+    (void)::poll(pfd, peer_pidfd ? 2 : 1, -1);
+}
+
+bool is_power_of_2(uint64_t n)
+{
+    return (n != 0 && (n & (n - 1)) == 0);
+}
+
+} // anonymous namespace
+
+
+/*----------------------------------------------------------------------------
+                                 shm_port::impl
+----------------------------------------------------------------------------*/
+
+struct shm_port::impl {
+    int side;
+    c7::fd memfd;
+    c7::fd bells[2][2];			// [side][DATA_BELL/SPACE_BELL]
+    c7::fd rx_ep;			// epoll of DATA_BELL and peer_pidfd (fd_number())
+    c7::fd peer_pidfd;			// opened when peer is other process
+    shm_segment *seg = nullptr;
+    size_t map_size = 0;
+    uint64_t mask = 0;
+    bool rd_nonblocking = false;
+    bool wr_nonblocking = false;
+    bool rx_armed = true;
+
+    ~impl() {
+	if (seg != nullptr) {
+	    ::munmap(seg, map_size);
+	}
+    }
+
+    result<> map(size_t capacity, bool init);
+    result<> attach();
+    bool watch_peer();
+
+    shm_ring& tx() { return seg->ring[side]; }
+    shm_ring& rx() { return seg->ring[1 - side]; }
+    char *tx_data() { return reinterpret_cast<char*>(seg) + data_offset + side * (mask + 1); }
+    char *rx_data() { return reinterpret_cast<char*>(seg) + data_offset + (1 - side) * (mask + 1); }
+    c7::fd& bell(int s, int kind) { return bells[s][kind]; }
+    bool peer_alive() { return seg->alive[1 - side].load(std::memory_order_acquire) != 0; }
+
+    void arm_rx() {
+	rx().rd_waiting.store(1, std::memory_order_seq_cst);
+	rx_armed = true;
+    }
+    void disarm_rx() {
+	if (rx_armed) {
+	    rx().rd_waiting.store(0, std::memory_order_relaxed);
+	    rx_armed = false;
+	}
+    }
+};
+
+
+result<>
+shm_port::impl::map(size_t capacity, bool init)
+{
+    map_size = data_offset + 2 * capacity;
+    if (init && ::ftruncate(memfd, map_size) == C7_SYSERR) {
+	return c7result_err(errno, "ftruncate(%{}, %{}) failed", memfd, map_size);
+    }
+    void *addr = ::mmap(nullptr, map_size, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (addr == MAP_FAILED) {
+	return c7result_err(errno, "mmap(%{}, %{}) failed", memfd, map_size);
+    }
+    seg = static_cast<shm_segment*>(addr);
+    mask = capacity - 1;
+    if (init) {
+	seg->magic = shm_magic;
+	seg->capacity = capacity;
+	seg->alive[0] = 1;
+	seg->alive[1] = 1;
+	// both readers are sleeping at first.
+	seg->ring[0].rd_waiting = 1;
+	seg->ring[1].rd_waiting = 1;
+    }
+    return c7result_ok();
+}
+
+// this process takes this side of mapped segment.
+result<>
+shm_port::impl::attach()
+{
+    int fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (fd == C7_SYSERR) {
+	return c7result_err(errno, "epoll_create1() failed");
+    }
+    rx_ep = c7::fd(fd);
+    ::epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = bell(side, DATA_BELL);
+    if (::epoll_ctl(rx_ep, EPOLL_CTL_ADD, ev.data.fd, &ev) == C7_SYSERR) {
+	return c7result_err(errno, "epoll_ctl(ADD, %{}) failed", ev.data.fd);
+    }
+    seg->pid[side].store(::getpid(), std::memory_order_release);
+    return c7result_ok();
+}
+
+// Start watching peer process when peer has moved to other process, and return
+// false if peer is not alive. Peer which died without close() is regarded as closed.
+bool
+shm_port::impl::watch_peer()
+{
+    if (!peer_alive()) {
+	return false;
+    }
+    if (!peer_pidfd) {
+	pid_t pid = seg->pid[1 - side].load(std::memory_order_acquire);
+	if (pid == ::getpid()) {
+	    return true;
+	}
+	int fd = ::syscall(SYS_pidfd_open, pid, 0);
+	if (fd == C7_SYSERR) {
+	    if (errno != ESRCH) {
+		return true;		// e.g. ENOSYS: peer death is not detected
+	    }
+	    seg->alive[1 - side].store(0, std::memory_order_release);
+	    return false;
+	}
+	peer_pidfd = c7::fd(fd);
+	::epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	(void)::epoll_ctl(rx_ep, EPOLL_CTL_ADD, fd, &ev);
+    }
+    ::pollfd pfd { peer_pidfd, POLLIN, 0 };
+    if (::poll(&pfd, 1, 0) > 0) {
+	// peer process terminated
+	seg->alive[1 - side].store(0, std::memory_order_release);
+	return false;
+    }
+    return true;
+}
+
+
+/*----------------------------------------------------------------------------
+                                    shm_port
+----------------------------------------------------------------------------*/
+
+shm_port::shm_port() = default;
+
+shm_port::~shm_port()
+{
+    close();
+}
+
+shm_port::shm_port(std::unique_ptr<impl>&& pimpl): pimpl_(std::move(pimpl)) {}
+
+shm_port::shm_port(shm_port&& o):
+    pimpl_(std::move(o.pimpl_)), on_close_(std::move(o.on_close_))
+{
+}
+
+shm_port& shm_port::operator=(shm_port&& o)
+{
+    if (this != &o) {
+	close();
+	pimpl_ = std::move(o.pimpl_);
+	on_close_ = std::move(o.on_close_);
+    }
+    return *this;
+}
+
+result<std::pair<shm_port, shm_port>>
+shm_port::make_pair(size_t capacity)
+{
+    size_t cap = 4096;
+    while (cap < capacity) {
+	cap <<= 1;
+    }
+
+    auto pimpl0 = std::make_unique<impl>();
+    pimpl0->side = 0;
+    if (int fd = ::memfd_create("c7event.shm_port", MFD_CLOEXEC); fd == C7_SYSERR) {
+	return c7result_err(errno, "memfd_create() failed");
+    } else {
+	pimpl0->memfd = c7::fd(fd);
+    }
+    for (auto& side_bells: pimpl0->bells) {
+	for (auto& bell: side_bells) {
+	    int fd = ::eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+	    if (fd == C7_SYSERR) {
+		return c7result_err(errno, "eventfd() failed");
+	    }
+	    bell = c7::fd(fd);
+	}
+    }
+    if (auto res = pimpl0->map(cap, true); !res) {
+	return res.as_error();
+    }
+    if (auto res = pimpl0->attach(); !res) {
+	return res.as_error();
+    }
+
+    auto pimpl1 = std::make_unique<impl>();
+    pimpl1->side = 1;
+    if (auto res = dup_fd(pimpl0->memfd); !res) {
+	return res.as_error();
+    } else {
+	pimpl1->memfd = std::move(res.value());
+    }
+    for (int s = 0; s < 2; s++) {
+	for (int k = 0; k < 2; k++) {
+	    if (auto res = dup_fd(pimpl0->bells[s][k]); !res) {
+		return res.as_error();
+	    } else {
+		pimpl1->bells[s][k] = std::move(res.value());
+	    }
+	}
+    }
+    if (auto res = pimpl1->map(cap, false); !res) {
+	return res.as_error();
+    }
+    if (auto res = pimpl1->attach(); !res) {
+	return res.as_error();
+    }
+
+    return c7result_ok(std::make_pair(shm_port(std::move(pimpl0)),
+				      shm_port(std::move(pimpl1))));
+}
+
+result<>
+shm_port::send_to(c7::socket& unix_sock)
+{
+    if (!pimpl_) {
+	return c7result_err(EBADF, "shm_port is not opened");
+    }
+    if (auto res = unix_sock.send_filedesc(pimpl_->memfd); !res) {
+	return res;
+    }
+    for (auto& side_bells: pimpl_->bells) {
+	for (auto& bell: side_bells) {
+	    if (auto res = unix_sock.send_filedesc(bell); !res) {
+		return res;
+	    }
+	}
+    }
+    int32_t side = pimpl_->side;
+    if (auto io_res = unix_sock.write_n(&side, sizeof(side)); !io_res) {
+	return c7result_err(std::move(io_res.get_result()), "send_to(%{}) failed", unix_sock);
+    }
+    // peer process has this side, so this port is released without notifying close.
+    pimpl_.reset();
+    on_close_ = c7::delegate<void>();
+    return c7result_ok();
+}
+
+result<shm_port>
+shm_port::recv_from(c7::socket& unix_sock)
+{
+    auto pimpl = std::make_unique<impl>();
+    if (auto res = unix_sock.recv_filedesc(); !res) {
+	return res.as_error();
+    } else {
+	pimpl->memfd = c7::fd(res.value());
+    }
+    for (auto& side_bells: pimpl->bells) {
+	for (auto& bell: side_bells) {
+	    if (auto res = unix_sock.recv_filedesc(); !res) {
+		return res.as_error();
+	    } else {
+		bell = c7::fd(res.value());
+	    }
+	}
+    }
+    int32_t side;
+    if (auto io_res = unix_sock.read_n(&side, sizeof(side)); !io_res) {
+	return c7result_err(std::move(io_res.get_result()), "recv_from(%{}) failed", unix_sock);
+    }
+    if (side != 0 && side != 1) {
+	return c7result_err(EINVAL, "recv_from(%{}): invalid side: %{}", unix_sock, side);
+    }
+    pimpl->side = side;
+
+    struct ::stat st;
+    if (::fstat(pimpl->memfd, &st) == C7_SYSERR) {
+	return c7result_err(errno, "fstat(%{}) failed", pimpl->memfd);
+    }
+    if (size_t(st.st_size) < data_offset || (st.st_size - data_offset) % 2 != 0 ||
+	!is_power_of_2((st.st_size - data_offset) / 2)) {
+	return c7result_err(EINVAL, "recv_from(%{}): invalid shared memory size: %{}",
+			    unix_sock, st.st_size);
+    }
+    size_t cap = (st.st_size - data_offset) / 2;
+    if (auto res = pimpl->map(cap, false); !res) {
+	return res.as_error();
+    }
+    if (pimpl->seg->magic != shm_magic || pimpl->seg->capacity != cap) {
+	return c7result_err(EINVAL, "recv_from(%{}): invalid shared memory", unix_sock);
+    }
+    if (auto res = pimpl->attach(); !res) {
+	return res.as_error();
+    }
+    // let peer start watching this process.
+    ring_bell(pimpl->bell(1 - side, DATA_BELL));
+    ring_bell(pimpl->bell(1 - side, SPACE_BELL));
+    return c7result_ok(shm_port(std::move(pimpl)));
+}
+
+int shm_port::fd_number() const
+{
+    return pimpl_ ? int(pimpl_->rx_ep) : -1;
+}
+
+bool shm_port::is_alive() const
+{
+    return bool(pimpl_);
+}
+
+result<> shm_port::set_nonblocking(bool enable)
+{
+    if (!pimpl_) {
+	return c7result_err(EBADF, "shm_port is not opened");
+    }
+    pimpl_->rd_nonblocking = enable;
+    pimpl_->wr_nonblocking = enable;
+    return c7result_ok();
+}
+
+result<> shm_port::set_nonblocking_read(bool enable)
+{
+    if (!pimpl_) {
+	return c7result_err(EBADF, "shm_port is not opened");
+    }
+    pimpl_->rd_nonblocking = enable;
+    return c7result_ok();
+}
+
+void shm_port::close()
+{
+    if (pimpl_) {
+	auto& m = *pimpl_;
+	m.seg->alive[m.side].store(0, std::memory_order_release);
+	ring_bell(m.bell(1 - m.side, DATA_BELL));
+	ring_bell(m.bell(1 - m.side, SPACE_BELL));
+	auto on_close = std::move(on_close_);
+	on_close();
+	pimpl_.reset();
+    }
+}
+
+io_result shm_port::read_n(void *bufaddr, size_t req_n)
+{
+    ::iovec iov[1] = {{ bufaddr, req_n }};
+    ::iovec *iovp = iov;
+    int ioc = 1;
+    return read_v(iovp, ioc);
+}
+
+io_result shm_port::read_v(::iovec*& iov, int& ioc)
+{
+    if (!pimpl_) {
+	return io_result(io_result::status::ERR, 0, 0,
+			 c7result_err(EBADF, "shm_port is not opened"));
+    }
+    auto& m = *pimpl_;
+    auto& ring = m.rx();
+    auto data = m.rx_data();
+    size_t n = 0;	// actual read bytes
+
+    for (;;) {
+	while (ioc > 0 && iov->iov_len == 0) {
+	    ioc--;
+	    iov++;
+	}
+	if (ioc == 0) {
+	    break;
+	}
+
+	uint64_t rpos = ring.rpos.load(std::memory_order_relaxed);
+	uint64_t avail = ring.wpos.load(std::memory_order_acquire) - rpos;
+	if (avail == 0) {
+	    // [MEMO] Doorbell is drained before arming, and ring is checked again after
+	    //        arming, so that data written concurrently is never missed.
+	    drain_bell(m.bell(m.side, DATA_BELL));
+	    m.arm_rx();
+	    if (ring.wpos.load(std::memory_order_seq_cst) != rpos) {
+		continue;
+	    }
+	    if (!m.watch_peer()) {
+		auto remain = iov->iov_len;
+		return (n == 0) ? io_result::closed(*this, remain) :
+		    io_result::incomp(*this, n, remain);
+	    }
+	    if (m.rd_nonblocking) {
+		return io_result(io_result::status::BUSY, n, iov->iov_len,
+				 c7result_err(EWOULDBLOCK, "read_v(%{}) (busy)", *this));
+	    }
+	    wait_bell(m.bell(m.side, DATA_BELL), m.peer_pidfd);
+	    continue;
+	}
+	m.disarm_rx();
+
+	size_t z = std::min<uint64_t>(avail, iov->iov_len);
+	size_t off = rpos & m.mask;
+	size_t z1 = std::min(z, m.mask + 1 - off);
+	std::memcpy(iov->iov_base, data + off, z1);
+	std::memcpy(static_cast<char*>(iov->iov_base) + z1, data, z - z1);
+	ring.rpos.store(rpos + z, std::memory_order_seq_cst);
+	if (ring.wr_waiting.load(std::memory_order_seq_cst) != 0 &&
+	    ring.wr_waiting.exchange(0) != 0) {
+	    ring_bell(m.bell(1 - m.side, SPACE_BELL));
+	}
+
+	n += z;
+	iov->iov_len -= z;
+	iov->iov_base = static_cast<char*>(iov->iov_base) + z;
+    }
+
+    // arm doorbell if ring became empty, because receiver wait next data by epoll.
+    // Doorbell is drained at first not to report EPOLLIN for data already read.
+    uint64_t rpos = ring.rpos.load(std::memory_order_relaxed);
+    if (ring.wpos.load(std::memory_order_acquire) == rpos) {
+	drain_bell(m.bell(m.side, DATA_BELL));
+	m.arm_rx();
+	if (ring.wpos.load(std::memory_order_seq_cst) != rpos) {
+	    // writer may not see rd_waiting, so ring doorbell by ourselves.
+	    m.disarm_rx();
+	    ring_bell(m.bell(m.side, DATA_BELL));
+	}
+    }
+    return io_result::ok(n);
+}
+
+io_result shm_port::write_v(::iovec*& iov, int& ioc)
+{
+    if (!pimpl_) {
+	return io_result(io_result::status::ERR, 0, 0,
+			 c7result_err(EBADF, "shm_port is not opened"));
+    }
+    auto& m = *pimpl_;
+    auto& ring = m.tx();
+    auto data = m.tx_data();
+    size_t n = 0;	// actual written bytes
+
+    for (;;) {
+	while (ioc > 0 && iov->iov_len == 0) {
+	    ioc--;
+	    iov++;
+	}
+	if (ioc == 0) {
+	    break;
+	}
+	if (!m.peer_alive()) {
+	    size_t remain = 0;
+	    for (int i = 0; i < ioc; i++) {
+		remain += iov[i].iov_len;
+	    }
+	    return io_result(io_result::status::ERR, n, remain,
+			     c7result_err(EPIPE, "write_v(%{}) (peer closed)", *this));
+	}
+
+	uint64_t wpos = ring.wpos.load(std::memory_order_relaxed);
+	uint64_t rpos = ring.rpos.load(std::memory_order_acquire);
+	uint64_t space = (m.mask + 1) - (wpos - rpos);
+	if (space == 0) {
+	    drain_bell(m.bell(m.side, SPACE_BELL));
+	    ring.wr_waiting.store(1, std::memory_order_seq_cst);
+	    if (ring.rpos.load(std::memory_order_seq_cst) != rpos || !m.watch_peer()) {
+		continue;
+	    }
+	    if (m.wr_nonblocking) {
+		size_t remain = 0;
+		for (int i = 0; i < ioc; i++) {
+		    remain += iov[i].iov_len;
+		}
+		return io_result(io_result::status::BUSY, n, remain,
+				 c7result_err(EWOULDBLOCK, "write_v(%{}) (busy)", *this));
+	    }
+	    wait_bell(m.bell(m.side, SPACE_BELL), m.peer_pidfd);
+	    continue;
+	}
+
+	size_t z = std::min<uint64_t>(space, iov->iov_len);
+	size_t off = wpos & m.mask;
+	size_t z1 = std::min(z, m.mask + 1 - off);
+	std::memcpy(data + off, iov->iov_base, z1);
+	std::memcpy(data, static_cast<char*>(iov->iov_base) + z1, z - z1);
+	ring.wpos.store(wpos + z, std::memory_order_seq_cst);
+	if (ring.rd_waiting.load(std::memory_order_seq_cst) != 0 &&
+	    ring.rd_waiting.exchange(0) != 0) {
+	    ring_bell(m.bell(1 - m.side, DATA_BELL));
+	}
+
+	n += z;
+	iov->iov_len -= z;
+	iov->iov_base = static_cast<char*>(iov->iov_base) + z;
+    }
+    return io_result::ok(n);
+}
+
+size_t shm_port::recv_buffered() const
+{
+    if (!pimpl_) {
+	return 0;
+    }
+    auto& ring = pimpl_->rx();
+    return ring.wpos.load(std::memory_order_acquire) - ring.rpos.load(std::memory_order_relaxed);
+}
+
+void shm_port::print(std::ostream& out, const std::string&) const
+{
+    if (pimpl_) {
+	c7::format(out, "shm_port<side:%{} mem:%{} bell:%{}>",
+		   pimpl_->side, int(pimpl_->memfd), fd_number());
+    } else {
+	c7::format(out, "shm_port<CLOSED>");
+    }
+}
+
+result<size_t> shm_port::read(void *bufaddr, size_t size)
+{
+    size_t n = std::min(std::max<size_t>(recv_buffered(), 1), size);
+    if (auto io_res = read_n(bufaddr, n); !io_res) {
+	return c7result_err(std::move(io_res.get_result()));
+    }
+    return c7result_ok(n);
+}
+
+result<size_t> shm_port::write(const void *bufaddr, size_t size)
+{
+    if (auto io_res = write_n(bufaddr, size); !io_res) {
+	return c7result_err(std::move(io_res.get_result()));
+    }
+    return c7result_ok(size);
+}
+
+io_result shm_port::write_n(const void *bufaddr, size_t req_n)
+{
+    ::iovec iov[1] = {{ const_cast<void*>(bufaddr), req_n }};
+    ::iovec *iovp = iov;
+    int ioc = 1;
+    return write_v(iovp, ioc);
+}
+
+
+} // namespace c7::event
@@ -0,0 +1,148 @@
+/*
+ * c7event/shm_port.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google document:
+ * https://docs.google.com/document/d/1_2Pj_MDBpX0PwGYouK46sXM1qWyUOi8iUv1zynuXqA0/edit?usp=sharing
+ */
+#ifndef C7_EVENT_SHM_PORT_HPP_LOADED_
+#define C7_EVENT_SHM_PORT_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7event/port.hpp>
+#include <c7event/traits.hpp>
+#include <c7socket.hpp>
+#include <memory>
+
+
+namespace c7::event {
+
+
+// port on shared memory ring
+// --------------------------
+//
+// - A pair of ports shares a memfd which has two SPSC byte rings (one for each
+//   direction). Data is copied into / out of the ring without system call.
+// - Each port has two eventfds as doorbell: one is signalled when data arrives
+//   (fd_number(), monitored by receiver), and another is signalled when space
+//   of outbound ring is released (waited by blocking write). Doorbells are
+//   signalled only when the peer is going to sleep.
+// - fd_number() is an epoll fd which watches the data doorbell and, after the
+//   peer has moved to another process, the pidfd of the peer process. So a peer
+//   which died without close() is regarded as closed.
+// - Reading by receiver is non-blocking (receiver_traits), so the monitor thread
+//   is never parked waiting for the rest of a message.
+// - The other port of make_pair() can be passed to another process through UNIX
+//   domain socket by send_to() and recv_from().
+//
+//   [Example]
+//
+//      using my_msgbuf = multipart_msgbuf<my_header, 2>;
+//      class my_service: public service_interface<my_msgbuf, shm_port> { ... };
+//
+//      auto [port, peer] = shm_port::make_pair().value();
+//      peer.send_to(unix_sock);			// peer process: shm_port::recv_from(unix_sock)
+//      manage_receiver(std::move(port), std::make_shared<my_service>());
+
+class shm_port: public port_rw_extention<shm_port> {
+public:
+    using delegate_id = delegate_base::id;
+
+    using port_rw_extention<shm_port>::read;
+    using port_rw_extention<shm_port>::read_n;
+    using port_rw_extention<shm_port>::write;
+    using port_rw_extention<shm_port>::write_n;
+
+    static constexpr size_t default_capacity = 1024 * 1024;	// each direction
+
+    shm_port();
+    ~shm_port();
+    shm_port(const shm_port&) = delete;
+    shm_port(shm_port&& o);
+    shm_port& operator=(const shm_port&) = delete;
+    shm_port& operator=(shm_port&&);
+
+    // capacity is rounded up to power of 2.
+    static result<std::pair<shm_port, shm_port>> make_pair(size_t capacity = default_capacity);
+
+    // pass this port to other process. (this port is closed if succeeded)
+    result<> send_to(c7::socket& unix_sock);
+    static result<shm_port> recv_from(c7::socket& unix_sock);
+
+    // receiver, connector
+    int fd_number() const;
+
+    // receiver
+    bool is_alive() const;
+
+    // receiver
+    template <typename Func> delegate_id
+    add_on_close(Func&& func) {
+	return on_close_.push_back([f = std::forward<Func>(func)](){ f(); });
+    }
+
+    void remove_on_close(delegate_id id) {
+	on_close_.remove(id);
+    }
+
+    // read_v/write_v return BUSY instead of waiting doorbell.
+    result<> set_nonblocking(bool enable);
+
+    // receiver: only read_v returns BUSY instead of waiting doorbell.
+    result<> set_nonblocking_read(bool enable);
+
+    // receiver
+    void close();
+
+    // multipart_msgbuf (always same host)
+    bool is_different_endian() { return false; }
+
+    // multipart_msgbuf
+    io_result read_n(void *bufaddr, size_t req_n);
+
+    // multipart_msgbuf
+    io_result read_v(::iovec*& iov_io, int& ioc_io);
+
+    // multipart_msgbuf
+    io_result write_v(::iovec*& iov_io, int& ioc_io);
+
+    // receiver: bytes which can be read without waiting
+    size_t recv_buffered() const;
+
+    // formattable
+    void print(std::ostream& out, const std::string& spec) const;
+
+    // for the user's code
+    result<size_t> read(void *bufaddr, size_t size);
+    result<size_t> write(const void *bufaddr, size_t size);
+    io_result write_n(const void *bufaddr, size_t req_n);
+
+private:
+    struct impl;
+    std::unique_ptr<impl> pimpl_;
+    c7::delegate<void> on_close_;
+
+    explicit shm_port(std::unique_ptr<impl>&& pimpl);
+};
+
+
+template <>
+struct splice_traits<shm_port> {
+    static inline constexpr bool spliceable = false;	// fd_number() is doorbell
+};
+
+template <>
+struct receiver_traits<shm_port> {
+    static inline constexpr bool nonblocking_read = true;
+};
+
+
+} // namespace c7::event
+
+
+#endif // c7event/shm_port.hpp
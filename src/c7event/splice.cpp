@@ -0,0 +1,246 @@
+/*
+ * c7event/splice.cpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ */
+
+
+#include <c7event/splice.hpp>
+#include <c7format.hpp>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+
+namespace c7::event {
+
+
+static void wait_fd(int fd, short events)
+{
+    ::pollfd pfd { fd, events, 0 };
+    (void)::poll(&pfd, 1, -1);
+}
+
+
+result<>
+splice_pipe::init(size_t pipe_size)
+{
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC|O_NONBLOCK) == C7_SYSERR) {
+	return c7result_err(errno, "pipe2() failed");
+    }
+    rd_ = c7::fd(fds[0]);
+    wr_ = c7::fd(fds[1]);
+    int z = ::fcntl(wr_, F_SETPIPE_SZ, int(pipe_size));
+    if (z == C7_SYSERR) {
+	z = ::fcntl(wr_, F_GETPIPE_SZ);		// pipe_size may exceed /proc/sys/fs/pipe-max-size
+    }
+    capacity_ = (z > 0) ? z : 65536;
+    return c7result_ok();
+}
+
+
+io_result
+splice_pipe::transfer(int in_fd, int out_fd, size_t n)
+{
+    if (!rd_) {
+	if (auto res = init(); !res) {
+	    return io_result(io_result::status::ERR, 0, n, std::move(res));
+	}
+    }
+
+    constexpr unsigned flags = SPLICE_F_MOVE|SPLICE_F_MORE|SPLICE_F_NONBLOCK;
+    size_t done = 0;		// bytes written to out_fd
+    size_t in_pipe = 0;		// bytes held in pipe
+
+    auto fail = [&](io_result::status status, int err, const char *what) {
+	// discard data left in pipe
+	rd_.close();
+	wr_.close();
+	capacity_ = 0;
+	return io_result(status, done, n - done,
+			 c7result_err(err, "splice(%{} -> %{}): %{}", in_fd, out_fd, what));
+    };
+
+    while (done < n) {
+	if (size_t rest = n - done - in_pipe; rest > 0 && in_pipe < capacity_) {
+	    ssize_t z = ::splice(in_fd, nullptr, wr_, nullptr,
+				 std::min(rest, capacity_ - in_pipe), flags);
+	    if (z > 0) {
+		in_pipe += z;
+	    } else if (z == 0) {
+		return fail(io_result::status::INCOMP, ENODATA, "maybe closed");
+	    } else if (errno != EWOULDBLOCK) {
+		return fail(io_result::status::ERR, errno, "error");
+	    } else if (in_pipe == 0) {
+		wait_fd(in_fd, POLLIN);
+		continue;
+	    }
+	}
+	if (in_pipe > 0) {
+	    ssize_t z = ::splice(rd_, nullptr, out_fd, nullptr, in_pipe, flags);
+	    if (z > 0) {
+		in_pipe -= z;
+		done += z;
+		transferred_ += z;
+	    } else if (z == C7_SYSERR && errno == EWOULDBLOCK) {
+		wait_fd(out_fd, POLLOUT);
+	    } else {
+		return fail(io_result::status::ERR, (z == 0) ? EPIPE : errno, "error");
+	    }
+	}
+    }
+    return io_result::ok(done);
+}
+
+
+io_result
+splice_pipe::fill(int in_fd, size_t n)
+{
+    constexpr unsigned flags = SPLICE_F_MOVE|SPLICE_F_MORE|SPLICE_F_NONBLOCK;
+    bool blocking = !is_nonblocking(in_fd);
+    size_t done = 0;
+    while (done < n) {
+	size_t req = n - done;
+	if (blocking) {
+	    // splice(2) from blocking TCP socket waits data even if SPLICE_F_NONBLOCK
+	    // is given, so only readable bytes are moved. EOF and error are reported
+	    // by splice without waiting because in_fd is readable.
+	    int avail = 0;
+	    if (::ioctl(in_fd, FIONREAD, &avail) != C7_SYSERR && avail > 0) {
+		req = std::min(req, size_t(avail));
+	    } else if (!is_readable(in_fd)) {
+		return io_result(io_result::status::BUSY, done, n - done,
+				 c7result_err(EWOULDBLOCK, "splice(%{} -> pipe) (busy)", in_fd));
+	    }
+	}
+	ssize_t z = ::splice(in_fd, nullptr, wr_, nullptr, req, flags);
+	if (z > 0) {
+	    done += z;
+	    held_ += z;
+	} else if (z == 0) {
+	    return io_result(io_result::status::INCOMP, done, n - done,
+			     c7result_err(ENODATA, "splice(%{} -> pipe): maybe closed", in_fd));
+	} else if (errno == EWOULDBLOCK) {
+	    return io_result(io_result::status::BUSY, done, n - done,
+			     c7result_err(EWOULDBLOCK, "splice(%{} -> pipe) (busy)", in_fd));
+	} else {
+	    return io_result(io_result::status::ERR, done, n - done,
+			     c7result_err(errno, "splice(%{} -> pipe) failed", in_fd));
+	}
+    }
+    return io_result::ok(done);
+}
+
+
+io_result
+splice_pipe::fill(const void *buf, size_t n)
+{
+    // pipe never becomes full because n <= capacity() - held().
+    auto iores = write_all(wr_, buf, n);
+    held_ += iores.get_done();
+    return iores;
+}
+
+
+io_result
+splice_pipe::flush(int out_fd, bool wait)
+{
+    constexpr unsigned flags = SPLICE_F_MOVE|SPLICE_F_MORE|SPLICE_F_NONBLOCK;
+    size_t done = 0;
+    while (held_ > 0) {
+	ssize_t z = ::splice(rd_, nullptr, out_fd, nullptr, held_, flags);
+	if (z > 0) {
+	    held_ -= z;
+	    done += z;
+	    transferred_ += z;
+	} else if (z == C7_SYSERR && errno == EWOULDBLOCK) {
+	    if (!wait) {
+		return io_result(io_result::status::BUSY, done, held_,
+				 c7result_err(EWOULDBLOCK, "splice(pipe -> %{}) (busy)", out_fd));
+	    }
+	    wait_fd(out_fd, POLLOUT);
+	} else {
+	    int err = (z == 0) ? EPIPE : errno;
+	    io_result iores(io_result::status::ERR, done, held_,
+			    c7result_err(err, "splice(pipe -> %{}) failed", out_fd));
+	    discard();
+	    return iores;
+	}
+    }
+    return io_result::ok(done);
+}
+
+
+io_result
+splice_pipe::drain(void *buf, size_t n)
+{
+    size_t done = 0;
+    while (done < n) {
+	ssize_t z = ::read(rd_, static_cast<char*>(buf) + done, n - done);
+	if (z > 0) {
+	    done += z;
+	    held_ -= z;
+	} else {
+	    // held data is always readable
+	    int err = (z == 0) ? ENODATA : errno;
+	    return io_result(io_result::status::ERR, done, n - done,
+			     c7result_err(err, "read(pipe) failed"));
+	}
+    }
+    return io_result::ok(done);
+}
+
+
+void
+splice_pipe::discard()
+{
+    if (held_ > 0) {
+	held_ = 0;
+	rd_.close();
+	wr_.close();
+	capacity_ = 0;
+    }
+}
+
+
+bool
+splice_pipe::is_nonblocking(int fd)
+{
+    int flags = ::fcntl(fd, F_GETFL);
+    return (flags != C7_SYSERR && (flags & O_NONBLOCK) != 0);
+}
+
+
+bool
+splice_pipe::is_readable(int fd)
+{
+    ::pollfd pfd { fd, POLLIN, 0 };
+    return (::poll(&pfd, 1, 0) > 0);
+}
+
+
+io_result
+splice_pipe::write_all(int fd, const void *buf, size_t n)
+{
+    size_t done = 0;
+    while (done < n) {
+	ssize_t z = ::write(fd, static_cast<const char*>(buf) + done, n - done);
+	if (z > 0) {
+	    done += z;
+	} else if (z == C7_SYSERR && errno == EWOULDBLOCK) {
+	    wait_fd(fd, POLLOUT);
+	} else {
+	    return io_result(io_result::status::ERR, done, n - done,
+			     c7result_err(errno, "write(%{}) failed", fd));
+	}
+    }
+    return io_result::ok(done);
+}
+
+
+} // namespace c7::event
@@ -0,0 +1,92 @@
+/*
+ * c7event/splice.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google document:
+ * https://docs.google.com/document/d/1_2Pj_MDBpX0PwGYouK46sXM1qWyUOi8iUv1zynuXqA0/edit?usp=sharing
+ */
+#ifndef C7_EVENT_SPLICE_HPP_LOADED_
+#define C7_EVENT_SPLICE_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7fd.hpp>
+
+
+namespace c7::event {
+
+
+// pipe for moving data between descriptors by splice(2)
+// -----------------------------------------------------
+//
+// - transfer() moves n bytes from in_fd to out_fd through the pipe without copying
+//   them into user space. If a descriptor is non-blocking, transfer() waits it by
+//   poll(2), so that n bytes are always moved unless error or EOF.
+// - fill() and flush() are resumable version used by multipart_msgbuf::relay():
+//   fill() moves data into the pipe without waiting, and flush() moves all data
+//   held in the pipe to out_fd.
+// - one pipe should be used by one thread (e.g. one for each monitor).
+
+class splice_pipe {
+public:
+    static constexpr size_t default_pipe_size = 1024 * 1024;
+
+    splice_pipe(const splice_pipe&) = delete;
+    splice_pipe& operator=(const splice_pipe&) = delete;
+
+    splice_pipe() = default;
+    splice_pipe(splice_pipe&&) = default;
+    splice_pipe& operator=(splice_pipe&&) = default;
+
+    result<> init(size_t pipe_size = default_pipe_size);
+
+    // pipe must be empty (held() == 0)
+    io_result transfer(int in_fd, int out_fd, size_t n);
+
+    // capacity of pipe (0 before init)
+    size_t capacity() const { return capacity_; }
+
+    // bytes held in pipe by fill()
+    size_t held() const { return held_; }
+
+    // move up to n bytes from in_fd (return BUSY if no data), or copy n bytes from buf
+    // into pipe. n must not exceed capacity() - held(). in_fd may be blocking socket
+    // (e.g. read by MSG_DONTWAIT): only readable bytes are moved.
+    io_result fill(int in_fd, size_t n);
+    io_result fill(const void *buf, size_t n);
+
+    // move all held data to out_fd. If wait is false, return BUSY when out_fd is not
+    // writable, and the rest is kept in pipe.
+    io_result flush(int out_fd, bool wait = true);
+
+    // read n bytes of held data into buf (to be written in other way)
+    io_result drain(void *buf, size_t n);
+
+    // discard held data
+    void discard();
+
+    static bool is_nonblocking(int fd);
+    static bool is_readable(int fd);
+
+    // write n bytes to fd directly (waiting by poll(2) if fd is non-blocking)
+    static io_result write_all(int fd, const void *buf, size_t n);
+
+    uint64_t transferred() const { return transferred_; }
+
+private:
+    c7::fd rd_;
+    c7::fd wr_;
+    size_t capacity_ = 0;
+    size_t held_ = 0;
+    uint64_t transferred_ = 0;
+};
+
+
+} // namespace c7::event
+
+
+#endif // c7event/splice.hpp
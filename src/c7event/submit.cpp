@@ -8,6 +8,7 @@
  */
 
 
+#include <c7defer.hpp>
 #include <c7event/submit.hpp>
 #include <sys/eventfd.h>
 
@@ -66,6 +67,21 @@ submit_provider::init()
 }
 
 
+submit_provider::~submit_provider()
+{
+    for (auto node = rest_; node != nullptr;) {
+	auto next = node->next;
+	delete node;
+	node = next;
+    }
+    for (auto node = callbacks_.pop_all(); node != nullptr;) {
+	auto next = node->next;
+	delete node;
+	node = next;
+    }
+}
+
+
 void
 submit_provider::on_event(c7::event::monitor&, int prvfd, uint32_t events)
 {
@@ -75,13 +91,40 @@ submit_provider::on_event(c7::event::monitor&, int prvfd, uint32_t events)
 	on_error(res);
 	return;
     }
-    for (uint64_t i = 0; i < submit_count; i++) {
-	if (auto q_res = callbacks_.get(0); !q_res) {
-	    auto res = c7result_err(std::move(q_res.as_error()),
-				    "rest submit count:%{} (from eventfd)", submit_count - i);
+
+    // Whole batch is taken at once, and submitter don't write eventfd while we are
+    // calling callbacks (awake_ is true).
+    awake_ = true;
+    auto node = callbacks_.pop_all();
+    if (rest_ != nullptr) {
+	auto tail = rest_;
+	while (tail->next != nullptr) {
+	    tail = tail->next;
+	}
+	tail->next = node;
+	node = std::exchange(rest_, nullptr);
+    }
+
+    // If a callback throws, the rest of the batch is kept for next event and
+    // the eventfd is written again, then the exception is propagated.
+    c7::scope_guard on_throw([this, &node]() {
+	    rest_ = node;
+	    awake_ = false;
+	    (void)wakeup();
+	});
+    while (node != nullptr) {
+	std::unique_ptr<callback_node> hold(node);
+	node = node->next;
+	hold->func();
+    }
+    on_throw.cancel();
+    awake_ = false;
+
+    // Callbacks submitted after pop_all are not handled in this time, they are
+    // handled on next event for fairness among providers.
+    if (!callbacks_.empty()) {
+	if (auto res = wakeup(); !res) {
 	    on_error(res);
-	} else {
-	    q_res.value()();
 	}
     }
 }
@@ -90,9 +133,18 @@ submit_provider::on_event(c7::event::monitor&, int prvfd, uint32_t events)
 c7::result<>
 submit_provider::submit(std::function<void()>&& f)
 {
-    if (auto res = callbacks_.put(std::move(f)); !res) {
-	return res;
+    auto node = new callback_node{nullptr, std::move(f)};
+    if (callbacks_.push(node) && !awake_) {
+	// queue was empty and event loop is not calling callbacks.
+	return wakeup();
     }
+    return c7result_ok();
+}
+
+
+c7::result<>
+submit_provider::wakeup()
+{
     uint64_t submit_count = 1;
     if (auto io_res = evfd_.write_n(&submit_count); !io_res) {
 	return c7result_err(std::move(io_res.get_result()), "Failed to write eventfd.");
@@ -15,8 +15,9 @@
 
 
 #include <c7event/monitor.hpp>
+#include <atomic>
 #include <c7fd.hpp>
-#include <c7thread/queue.hpp>
+#include <c7thread/mpsc.hpp>
 
 
 namespace c7::event {
@@ -31,15 +32,24 @@ public:
     static c7::result<std::shared_ptr<submit_provider>> make_and_manage();
     static c7::result<std::shared_ptr<submit_provider>> make_and_manage(c7::event::monitor&);
 
-    ~submit_provider() override = default;
+    ~submit_provider() override;
     int fd() override { return evfd_; }
     void on_event(c7::event::monitor&, int prvfd, uint32_t events) override;
 
     c7::result<> submit(std::function<void()>&& f);
 
 private:
+    struct callback_node {
+	callback_node *next;
+	std::function<void()> func;
+    };
+
     c7::fd evfd_;
-    c7::thread::queue<std::function<void()>> callbacks_;
+    c7::thread::mpsc_queue<callback_node> callbacks_;
+    std::atomic<bool> awake_ {false};	// true while on_event is calling callbacks
+    callback_node *rest_ = nullptr;	// left by a callback which threw (FIFO order)
+
+    c7::result<> wakeup();
 
     static c7::result<std::shared_ptr<submit_provider>> make();
 
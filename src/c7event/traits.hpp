@@ -14,6 +14,9 @@
 #include <c7common.hpp>
 
 
+#include <c7typefunc.hpp>
+
+
 namespace c7::event {
 
 
@@ -33,6 +36,27 @@ struct lock_traits {
 };
 
 
+template <typename T>
+struct splice_traits {
+    // true if fd_number() of port T is a stream which can be used with splice(2).
+    static inline constexpr bool spliceable = true;
+};
+
+
+template <typename T>
+struct receiver_traits {
+    // true if receiver makes reading of port T non-blocking by set_nonblocking_read(),
+    // so that incomplete message is resumed on next EPOLLIN instead of blocking
+    // monitor thread until the rest arrives.
+    static inline constexpr bool nonblocking_read = false;
+};
+
+
+// optional features of port
+c7typefunc_define_has_member(recv_buffered);	// C7_EVENT_PORT_RECV_BUFFER
+c7typefunc_define_has_member(send_queued);	// C7_EVENT_PORT_SEND_QUEUE
+
+
 } // namespace c7::event
 
 
@@ -339,6 +339,59 @@ io_result fd::write_n(const void *buf, size_t const req_n)
     return io_result::ok(n);
 }
 
+io_result fd::read_v(::iovec*& iov, int& ioc)
+{
+    size_t n = 0;	// actual read bytes
+
+    while (ioc > 0) {
+	if (iov->iov_len == 0) {
+	    ioc--;
+	    iov++;
+	    continue;
+	}
+	ssize_t z = ::readv(fdnum_, iov, ioc);
+	if (z <= 0) {
+	    size_t remain = 0;
+	    for (int i = 0; i < ioc; i++) {
+		remain += iov[i].iov_len;
+	    }
+	    auto status = io_result::status::ERR;
+	    const char *descrip = "error";
+
+	    if (z == 0 && n == 0) {
+		status = io_result::status::CLOSED;
+		descrip = "maybe closed";
+		errno = ENODATA;
+	    } else if (z == 0) {
+		status = io_result::status::INCOMP;
+		descrip = "maybe closed";
+		errno = ENODATA;
+	    } else if (errno == EWOULDBLOCK) {
+		status = io_result::status::BUSY;
+		descrip = "busy";
+	    }
+	    return io_result(status, n, remain,
+			     c7result_err(errno,
+					  "read_v(%{}) -> %{} (%{})", *this, n, descrip));
+	}
+	n += z;
+	while (z > 0) {
+	    if (iov->iov_len <= (size_t)z) {
+		z -= iov->iov_len;
+		iov->iov_len = 0;
+		iov->iov_base = nullptr;
+		iov++;
+		ioc--;
+	    } else if (iov->iov_len > (size_t)z) {
+		iov->iov_len -= z;
+		iov->iov_base = (char *)iov->iov_base + z;
+		break;
+	    }
+	}
+    }
+    return io_result::ok(n);
+}
+
 io_result fd::write_v(::iovec*& iov, int& ioc)
 {
     size_t n = 0;	// actual writen bytes
@@ -246,6 +246,14 @@ public:
 	return write_n(buf, sizeof(T)*N);
     }
 
+    io_result read_v(::iovec* const iov, const int& ioc) {
+	::iovec *iovp = iov;
+	int ioc_io = ioc;
+	return read_v(iovp, ioc_io);
+    }
+
+    io_result read_v(::iovec*& iov_io, int& ioc_io);
+
     io_result write_v(::iovec* const iov, const int& ioc) {
 	::iovec *iovp = iov;
 	int ioc_io = ioc;
@@ -15,6 +15,7 @@
 
 
 #include <c7thread/condvar.hpp>
+#include <c7thread/fastlock.hpp>
 #include <c7thread/spinlock.hpp>
 #include <memory>
 
@@ -166,6 +167,10 @@ private:
     bool mpool_attached_ = false;
     size_t lending_ = 0;
 
+    c7::thread::lock_guard<strategy> lock() {
+	return c7::thread::lock_guard<strategy>(*this);
+    }
+
     pointer<T> get() {
 	auto defer = lock();
 	lending_++;
@@ -213,8 +218,11 @@ private:
     }
 
 protected:
+    friend class c7::thread::lock_guard<strategy>;
+
     virtual ~strategy() {}
-    virtual c7::defer lock() = 0;
+    virtual void _lock() = 0;
+    virtual void unlock() = 0;
     virtual item<T> *alloc() = 0;
     virtual void wait() {}
     virtual void notify() {}
@@ -276,17 +284,17 @@ private:
                              allocation strategy
 ----------------------------------------------------------------------------*/
 
-class dummy_lock {
+class dummy_lock: public c7::thread::fastlock_base<dummy_lock> {
 public:
-    c7::defer lock() {
-	return c7::defer();
-    }
+    void _lock() {}
+    bool _trylock() { return true; }
+    void unlock() {}
 };
 
 
 // multiple allocation, no wait
 
-template <typename T, typename Locker = c7::thread::spinlock>
+template <typename T, typename Locker = c7::thread::ttas_spinlock>
 class chunk_strategy: public strategy<T> {
 public:
     static strategy<T> *make(int chunk_size) {
@@ -312,8 +320,12 @@ private:
 	chunks_.clear();
     }
 
-    c7::defer lock() {
-	return lock_.lock();
+    void _lock() {
+	lock_._lock();
+    }
+
+    void unlock() {
+	lock_.unlock();
     }
 
     item<T> *alloc() {
@@ -359,8 +371,12 @@ private:
 	chunks_.clear();
     }
 
-    c7::defer lock() {
-	return cv_.lock();
+    void _lock() {
+	cv_._lock();
+    }
+
+    void unlock() {
+	cv_.unlock();
     }
 
     item<T> *alloc() {
@@ -400,7 +416,7 @@ private:
 template <typename T>
 using mpool_ptr = c7::mpool::pointer<T>;
 
-template <typename T, typename Locker = c7::thread::spinlock>
+template <typename T, typename Locker = c7::thread::ttas_spinlock>
 mpool::mpool<T> mpool_chunk(int chunk_size)
 {
     return mpool::mpool<T>(mpool::chunk_strategy<T, Locker>::make, chunk_size);
@@ -303,7 +303,7 @@ proc::impl::start(const std::string& prog,
 
     // Next lock is important to prevent SIGCHLD handler from accessing this proc
     // object and calling on_finish delegate before on_start.
-    auto unlock_defer = cv_.lock();
+    c7::defer unlock_defer = cv_.lock();
 
     auto self = shared_from_this();
     pid_ = res.value();
@@ -339,7 +339,7 @@ proc::impl::manage(pid_t pid, const std::string& prog)
     argv_ = c7::strvec{prog_};
 
     // IMPORTANT: same above reason
-    auto unlock_defer = cv_.lock();
+    c7::defer unlock_defer = cv_.lock();
 
     pid_ = pid;
     state_ = RUNNING;
@@ -262,9 +262,9 @@ result<> socket::listen(int backlog)
     return c7result_ok();
 }
 
-result<socket> socket::accept()
+result<socket> socket::accept(int flags)
 {
-    int newfd = ::accept(fdnum_, nullptr, nullptr);
+    int newfd = ::accept4(fdnum_, nullptr, nullptr, flags);
     if (newfd == C7_SYSERR) {
 	return c7result_err(errno, "accept(%{}) failed", fdnum_);
     }
@@ -329,6 +329,12 @@ result<> socket::tcp_nodelay(bool enable)
     return socket::setsockopt(IPPROTO_TCP, TCP_NODELAY, &avail, sizeof(avail));
 }
 
+result<> socket::set_reuseport(bool enable)
+{
+    int avail = int(enable);
+    return socket::setsockopt(SOL_SOCKET, SO_REUSEPORT, &avail, sizeof(avail));
+}
+
 result<> socket::set_rcvbuf(int nbytes)	// server:before listen, client:before conenct
 {
     return socket::setsockopt(SOL_SOCKET, SO_RCVBUF, &nbytes, sizeof(nbytes));
@@ -393,6 +399,62 @@ io_result socket::recvfrom(void *buf, size_t bufsize, sockaddr_gen& addr, int fl
     }
 }
 
+io_result socket::recv_v(::iovec*& iov, int& ioc, int flags)
+{
+    size_t n = 0;	// actual read bytes
+
+    while (ioc > 0) {
+	if (iov->iov_len == 0) {
+	    ioc--;
+	    iov++;
+	    continue;
+	}
+	::msghdr msg {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = ioc;
+	ssize_t z = ::recvmsg(fdnum_, &msg, flags);
+	if (z <= 0) {
+	    size_t remain = 0;
+	    for (int i = 0; i < ioc; i++) {
+		remain += iov[i].iov_len;
+	    }
+	    auto status = io_result::status::ERR;
+	    const char *descrip = "error";
+
+	    if (z == 0 && n == 0) {
+		status = io_result::status::CLOSED;
+		descrip = "maybe closed";
+		errno = ENODATA;
+	    } else if (z == 0) {
+		status = io_result::status::INCOMP;
+		descrip = "maybe closed";
+		errno = ENODATA;
+	    } else if (errno == EWOULDBLOCK) {
+		status = io_result::status::BUSY;
+		descrip = "busy";
+	    }
+	    return io_result(status, n, remain,
+			     c7result_err(errno,
+					  "recv_v(%{}) -> %{} (%{})", *this, n, descrip));
+	}
+	n += z;
+	while (z > 0) {
+	    if (iov->iov_len <= (size_t)z) {
+		z -= iov->iov_len;
+		iov->iov_len = 0;
+		iov->iov_base = nullptr;
+		iov++;
+		ioc--;
+	    } else {
+		iov->iov_len -= z;
+		iov->iov_base = (char *)iov->iov_base + z;
+		break;
+	    }
+	}
+    }
+    return io_result::ok(n);
+}
+
 io_result socket::sendto(const void *buf, size_t bufsize, const sockaddr_gen& addr, int flags)
 {
     ssize_t n = ::sendto(fdnum_, buf, bufsize, flags, &addr.base, addr.socklen());
@@ -407,6 +469,105 @@ io_result socket::sendto(const void *buf, size_t bufsize, const sockaddr_gen& ad
     }
 }
 
+// mmsghdr and its attachments for one system call
+namespace {
+struct mmsg_batch {
+    static constexpr int max_msg = socket::mmsg_max;
+    static constexpr size_t cmsg_size = CMSG_SPACE(sizeof(uint16_t)) > CMSG_SPACE(sizeof(int)) ?
+					CMSG_SPACE(sizeof(uint16_t)) : CMSG_SPACE(sizeof(int));
+    ::mmsghdr msgs[max_msg];
+    ::iovec iovs[max_msg];
+    alignas(::cmsghdr) char cmsgs[max_msg][cmsg_size];
+};
+}
+
+result<int> socket::recvmmsg(datagram *dgs, int n, int flags)
+{
+    thread_local mmsg_batch b;
+    n = std::min(n, mmsg_batch::max_msg);
+    for (int i = 0; i < n; i++) {
+	b.iovs[i] = { dgs[i].buf, dgs[i].size };
+	auto& h = b.msgs[i].msg_hdr;
+	h.msg_name = &dgs[i].addr.base;
+	h.msg_namelen = sizeof(dgs[i].addr);
+	h.msg_iov = &b.iovs[i];
+	h.msg_iovlen = 1;
+	h.msg_control = b.cmsgs[i];
+	h.msg_controllen = mmsg_batch::cmsg_size;
+	h.msg_flags = 0;
+    }
+    int ret = ::recvmmsg(fdnum_, b.msgs, n, flags, nullptr);
+    if (ret == C7_SYSERR) {
+	return c7result_err(errno, "recvmmsg(%{}) failed", *this);
+    }
+    for (int i = 0; i < ret; i++) {
+	auto& h = b.msgs[i].msg_hdr;
+	dgs[i].size = b.msgs[i].msg_len;
+	dgs[i].gso_size = 0;
+#if defined(UDP_GRO)
+	for (auto cmsg = CMSG_FIRSTHDR(&h); cmsg != nullptr; cmsg = CMSG_NXTHDR(&h, cmsg)) {
+	    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+		int gso;
+		std::memcpy(&gso, CMSG_DATA(cmsg), sizeof(gso));
+		dgs[i].gso_size = gso;
+	    }
+	}
+#endif
+    }
+    return c7result_ok(ret);
+}
+
+result<int> socket::sendmmsg(const datagram *dgs, int n, int flags)
+{
+    thread_local mmsg_batch b;
+    int sent = 0;
+    while (sent < n) {
+	int k = std::min(n - sent, mmsg_batch::max_msg);
+	for (int i = 0; i < k; i++) {
+	    auto& dg = dgs[sent + i];
+	    b.iovs[i] = { dg.buf, dg.size };
+	    auto& h = b.msgs[i].msg_hdr;
+	    h = ::msghdr{};
+	    if (dg.addr.base.sa_family != AF_UNSPEC) {
+		h.msg_name = const_cast<::sockaddr*>(&dg.addr.base);
+		h.msg_namelen = dg.addr.socklen();
+	    }
+	    h.msg_iov = &b.iovs[i];
+	    h.msg_iovlen = 1;
+#if defined(UDP_SEGMENT)
+	    if (dg.gso_size != 0) {
+		h.msg_control = b.cmsgs[i];
+		h.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+		auto cmsg = CMSG_FIRSTHDR(&h);
+		cmsg->cmsg_level = SOL_UDP;
+		cmsg->cmsg_type = UDP_SEGMENT;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		std::memcpy(CMSG_DATA(cmsg), &dg.gso_size, sizeof(uint16_t));
+	    }
+#endif
+	}
+	int ret = ::sendmmsg(fdnum_, b.msgs, k, flags);
+	if (ret == C7_SYSERR) {
+	    if (sent > 0 && errno == EWOULDBLOCK) {
+		break;
+	    }
+	    return c7result_err(errno, "sendmmsg(%{}) failed: sent:%{}", *this, sent);
+	}
+	sent += ret;
+    }
+    return c7result_ok(sent);
+}
+
+result<> socket::udp_gro(bool enable)
+{
+#if defined(UDP_GRO)
+    int avail = int(enable);
+    return socket::setsockopt(SOL_UDP, UDP_GRO, &avail, sizeof(avail));
+#else
+    return c7result_err(ENOTSUP, "UDP_GRO is not supported");
+#endif
+}
+
 c7::result<> socket::send_filedesc(int fd)
 {
     msghdr msg{};
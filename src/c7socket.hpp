@@ -21,6 +21,7 @@
 
 
 #define C7_SOCKET_DESCPASS	(1U)
+#define C7_SOCKET_MMSG		(1U)
 
 
 namespace c7 {
@@ -44,6 +45,16 @@ struct sockaddr_gen {
 };
 
 
+// C7_SOCKET_MMSG: element of recvmmsg/sendmmsg batch
+struct datagram {
+    void *buf;		// recv: buffer to be received into,  send: data to be sent
+    size_t size;	// recv: [in] buffer size, [out] received size,  send: data size
+    sockaddr_gen addr;	// recv: source address,  send: destination address (ignored if connected)
+    uint16_t gso_size;	// recv: segment size if coalesced by UDP_GRO (0: single datagram)
+			// send: segment size for UDP_SEGMENT (0: single datagram)
+};
+
+
 result<sockaddr_gen> sockaddr_unix(const std::string& path);
 sockaddr_gen sockaddr_ipv4(uint32_t ipaddr, int port);
 result<sockaddr_gen> sockaddr_ipv4(const std::string& host, int port);
@@ -87,7 +98,7 @@ public:
 
     result<> listen(int backlog = 0);
 
-    result<socket> accept();
+    result<socket> accept(int flags = 0);	// flags of accept4: SOCK_NONBLOCK, SOCK_CLOEXEC
 
     result<sockaddr_gen> self() const;
     result<sockaddr_gen> peer() const;
@@ -97,6 +108,7 @@ public:
 
     result<> tcp_keepalive(bool enable);
     result<> tcp_nodelay(bool enable);
+    result<> set_reuseport(bool enable);	// before bind
     result<> set_rcvbuf(int nbytes);	// server:before listen, client:before conenct
     result<> set_sndbuf(int nbytes);
     result<> set_sndtmo(c7::usec_t timeout);
@@ -116,6 +128,9 @@ public:
 	return recvfrom(buf, sizeof(*buf), addr, flags);
     }
 
+    // same as read_v except that recvmsg(2) is called with flags (e.g. MSG_DONTWAIT)
+    io_result recv_v(::iovec*& iov_io, int& ioc_io, int flags);
+
     io_result sendto(const void *buf, size_t bufsize, const sockaddr_gen&, int flags = 0);
     template <typename T>
     io_result sendto(const T *buf, size_t bufsize, const sockaddr_gen& addr, int flags = 0) {
@@ -126,6 +141,19 @@ public:
 	return sendto(buf, sizeof(*buf), addr, flags);
     }
 
+    // C7_SOCKET_MMSG
+    //
+    // - recvmmsg receives at most min(n, mmsg_max) datagrams by one system call, and
+    //   return number of received datagrams. EWOULDBLOCK is returned as error if
+    //   nothing is received.
+    // - sendmmsg sends dgs[0..n) by as few system calls as possible, and return number
+    //   of sent datagrams. It may be less than n only if socket is non-blocking.
+    // - udp_gro enable UDP_GRO (coalesced receive) if available.
+    static constexpr int mmsg_max = 64;
+    result<int> recvmmsg(datagram *dgs, int n, int flags = MSG_DONTWAIT);
+    result<int> sendmmsg(const datagram *dgs, int n, int flags = 0);
+    result<> udp_gro(bool enable);
+
     // C7_SOCKET_DESCPASS
     c7::result<> send_filedesc(int fd);
     c7::result<int> recv_filedesc();
@@ -14,6 +14,7 @@
 #include <c7common.hpp>
 
 
+#include <c7thread/fastlock.hpp>
 #include <c7thread/spinlock.hpp>
 #include <c7thread/mutex.hpp>
 #include <c7thread/condvar.hpp>
@@ -17,16 +17,29 @@
 #include <c7result.hpp>
 #include <c7utils/time.hpp>
 #include <c7thread/condvar.hpp>
+#include <c7thread/mutex.hpp>
 
 
 namespace c7::thread {
 
 
+// common part of queue, jobque and weight_jobque
+// ----------------------------------------------
+//
+// - Producers wait on cv_put_ (not full), consumers wait on cv_get_ (not empty),
+//   and other waiters (wait_finished etc.) on cv_ (status or commit). All of them
+//   share mtx_, and put/get wake only one waiter of other side.
+// - put_n/get_n move many items in one lock hold. They return the number of
+//   moved items, and return error only if no item is moved.
+
 template <typename T, typename Target>
 class queue_base {
 private:
     enum run_status { ALIVE, CLOSING, CLOSED, ABORTED };
-    condvar cv_;
+    mutex mtx_;
+    condvar cv_ {mtx_};
+    condvar cv_put_ {mtx_};
+    condvar cv_get_ {mtx_};
     run_status status_ = ALIVE;
 
     bool is_empty() const {
@@ -59,42 +72,29 @@ private:
 	return static_cast<Target*>(this)->end();
     }
 
-protected:
-    c7::defer cv_lock() {
-	return cv_.lock();
-    }
-
-    bool cv_wait(const ::timespec* timeout_abs) {
-	return cv_.wait(timeout_abs);
-    }
-
-    void cv_notify_all() {
+    void notify_all_waiters() {
 	cv_.notify_all();
+	cv_put_.notify_all();
+	cv_get_.notify_all();
     }
 
-    c7::result<> put(T&& item, size_t weight, c7::usec_t tmo_us = -1) {
-	auto unlock = cv_.lock();
-	auto abstime_p = c7::mktimespec(tmo_us);
+    // wait until weight can be put (lock must be held)
+    c7::result<> wait_put(size_t weight, const ::timespec *abstime_p) {
 	while (is_alive() && is_overflow(weight)) {
-	    if (!cv_.wait(abstime_p)) {
+	    if (!cv_put_.wait(abstime_p)) {
 		return c7result_err(ETIMEDOUT);
 	    }
 	}
-	if (is_alive()) {
-	    put_item(std::move(item), weight);
-	    cv_.notify_all();
-	    return c7result_ok();
-	} else {
+	if (!is_alive()) {
 	    return c7result_err(EPIPE, "queue is not alived (closing/closed/aborted)");
 	}
+	return c7result_ok();
     }
 
-    c7::result<T> get(size_t& weight, c7::usec_t tmo_us = -1) {
-	weight = 0;
-	auto unlock = cv_.lock();
-	auto abstime_p = c7::mktimespec(tmo_us);
+    // wait until an item can be got (lock must be held)
+    c7::result<> wait_get(const ::timespec *abstime_p) {
 	while (is_alive() && is_empty()) {
-	    if (!cv_.wait(abstime_p)) {
+	    if (!cv_get_.wait(abstime_p)) {
 		return c7result_err(ETIMEDOUT);
 	    }
 	}
@@ -107,20 +107,105 @@ protected:
 	if (is_empty()) {
 	    return c7result_err(ENODATA, "queue is closing");
 	}
-	auto item = get_item(weight);
+	return c7result_ok();
+    }
+
+protected:
+    lock_guard<mutex> cv_lock() {
+	return mtx_.lock();
+    }
+
+    bool cv_wait(const ::timespec* timeout_abs) {
+	return cv_.wait(timeout_abs);
+    }
+
+    void cv_notify_all() {
 	cv_.notify_all();
+    }
+
+    c7::result<> put(T&& item, size_t weight, c7::usec_t tmo_us = -1) {
+	auto unlock = mtx_.lock();
+	if (auto res = wait_put(weight, c7::mktimespec(tmo_us)); !res) {
+	    return res;
+	}
+	put_item(std::move(item), weight);
+	cv_get_.notify();
+	return c7result_ok();
+    }
+
+    c7::result<T> get(size_t& weight, c7::usec_t tmo_us = -1) {
+	weight = 0;
+	auto unlock = mtx_.lock();
+	if (auto res = wait_get(c7::mktimespec(tmo_us)); !res) {
+	    return res.as_error();
+	}
+	auto item = get_item(weight);
+	cv_put_.notify();
 	return c7result_ok(std::move(item));
     }
 
+    // weight_of(*it) -> size_t, move_of(*it) -> T&&
+    template <typename Iter, typename WeightOf, typename MoveOf>
+    c7::result<size_t> put_n(Iter first, Iter last, WeightOf weight_of, MoveOf move_of,
+			     c7::usec_t tmo_us = -1) {
+	auto unlock = mtx_.lock();
+	auto abstime_p = c7::mktimespec(tmo_us);
+	size_t n = 0;
+	for (; first != last; ++first, ++n) {
+	    auto weight = weight_of(*first);
+	    if (is_overflow(weight)) {
+		cv_get_.notify_all();		// consumers must run while producer waits
+	    }
+	    if (auto res = wait_put(weight, abstime_p); !res) {
+		if (n == 0) {
+		    return res.as_error();
+		}
+		break;
+	    }
+	    put_item(move_of(*first), weight);
+	}
+	if (n == 1) {
+	    cv_get_.notify();
+	} else {
+	    cv_get_.notify_all();
+	}
+	return c7result_ok(n);
+    }
+
+    // sink(T&&, size_t weight)
+    template <typename Sink>
+    c7::result<size_t> get_n(Sink sink, size_t max_n, c7::usec_t tmo_us = -1) {
+	auto unlock = mtx_.lock();
+	if (auto res = wait_get(c7::mktimespec(tmo_us)); !res) {
+	    return res.as_error();
+	}
+	size_t n = 0;
+	while (n < max_n && !is_empty()) {
+	    size_t weight = 0;
+	    auto item = get_item(weight);
+	    sink(std::move(item), weight);
+	    n++;
+	}
+	if (n == 1) {
+	    cv_put_.notify();
+	} else {
+	    cv_put_.notify_all();
+	}
+	return c7result_ok(n);
+    }
+
     c7::result<> commit(size_t weight) {
-	auto unlock = cv_.lock();
+	auto unlock = mtx_.lock();
 	if (auto res = commit_job(weight); !res) {
 	    return res;
 	}
 	if (is_closing() && is_idle()) {
 	    status_ = CLOSED;
+	    notify_all_waiters();
+	} else {
+	    cv_.notify_all();
+	    cv_put_.notify_all();		// weight_jobque: limit is released by commit
 	}
-	cv_.notify_all();
 	return c7result_ok();
     }
 
@@ -141,20 +226,20 @@ protected:
 
 public:
     void close() {
-	auto unlock = cv_.lock();
+	auto unlock = mtx_.lock();
 	if (is_idle()) {
 	    status_ = CLOSED;
 	} else {
 	    status_ = CLOSING;
 	}
-	cv_.notify_all();
+	notify_all_waiters();
     }
 
     void abort() {
-	auto unlock = cv_.lock();
+	auto unlock = mtx_.lock();
 	clear_queue();
 	status_ = ABORTED;
-	cv_.notify_all();
+	notify_all_waiters();
     }
 
     void reset() {
@@ -164,7 +249,7 @@ public:
 
     template <typename Func>
     c7::result<> scan(Func func) {
-	auto unlock = cv_.lock();
+	auto unlock = mtx_.lock();
 	for (auto it = begin(); it != end(); ++it) {
 	    if (auto res = func(&*it); !res) {
 		return res;
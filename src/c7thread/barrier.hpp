@@ -0,0 +1,120 @@
+/*
+ * c7thread/barrier.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google spreadsheets:
+ * (Nothing)
+ */
+#ifndef C7_THREAD_BARRIER_HPP_LOADED_
+#define C7_THREAD_BARRIER_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7thread/futex.hpp>
+#include <atomic>
+#include <functional>
+#include <sched.h>
+
+
+namespace c7::thread {
+
+
+// reusable barrier on futex
+// -------------------------
+//
+// - Sense-reversing barrier generalized to phase counter: arrivals are counted
+//   by an atomic counter, and the last arriver advances phase_ (futex word) and
+//   wakes all waiters by one FUTEX_WAKE. There is no lock and no limit of the
+//   number of participants.
+// - arrive() and wait() can be separated: a participant which need not wait
+//   (e.g. producer) can arrive and continue its work, and wait later by the
+//   token returned from arrive().
+// - completion function is called by the last arriver before the waiters are
+//   released.
+// - abort() releases all current and future waiters with false. (until reset())
+//
+//   [Example]
+//
+//      c7::thread::barrier bar(n_thread);
+//      ... on each thread: bar.arrive_and_wait();
+
+class barrier {
+public:
+    using token_t = uint32_t;
+
+    barrier(const barrier&) = delete;
+    barrier(barrier&&) = delete;
+    barrier& operator=(const barrier&) = delete;
+    barrier& operator=(barrier&&) = delete;
+
+    explicit barrier(int n_entry = 0, std::function<void()> completion = {}):
+	n_entry_(n_entry), remain_(n_entry), completion_(std::move(completion)) {
+    }
+
+    // must not be called while other threads use this barrier
+    void reset(int n_entry, std::function<void()> completion = {}) {
+	n_entry_ = n_entry;
+	remain_.store(n_entry, std::memory_order_relaxed);
+	completion_ = std::move(completion);
+	aborted_.store(false, std::memory_order_relaxed);
+	phase_.fetch_add(1, std::memory_order_release);
+    }
+
+    token_t arrive() {
+	auto token = phase_.load(std::memory_order_acquire);
+	if (remain_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+	    if (completion_) {
+		completion_();
+	    }
+	    remain_.store(n_entry_, std::memory_order_relaxed);
+	    phase_.fetch_add(1, std::memory_order_release);
+	    futex_wake_all(phase_);
+	}
+	return token;
+    }
+
+    // return false if aborted
+    bool wait(token_t token) {
+	for (int i = 0; phase_.load(std::memory_order_acquire) == token && !is_aborted(); i++) {
+	    if (i < spin_count) {
+		sched_yield();
+	    } else {
+		(void)futex_wait(phase_, token);
+	    }
+	}
+	return !aborted_.load(std::memory_order_acquire);
+    }
+
+    bool arrive_and_wait() {
+	return wait(arrive());
+    }
+
+    void abort() {
+	aborted_.store(true, std::memory_order_release);
+	phase_.fetch_add(1, std::memory_order_release);
+	futex_wake_all(phase_);
+    }
+
+    bool is_aborted() const {
+	return aborted_.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr int spin_count = 16;	// sched_yield() before futex wait
+
+    int n_entry_;
+    alignas(64) std::atomic<int> remain_;
+    alignas(64) std::atomic<token_t> phase_ {0};
+    std::atomic<bool> aborted_ {false};
+    std::function<void()> completion_;
+};
+
+
+} // namespace c7::thread
+
+
+#endif // c7thread/barrier.hpp
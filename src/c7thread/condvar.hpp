@@ -14,7 +14,7 @@
 #include <c7common.hpp>
 
 
-#include <c7defer.hpp>
+#include <c7thread/lock_guard.hpp>
 
 
 namespace c7::thread {
@@ -47,17 +47,13 @@ public:
     void notify_all();
 
     [[nodiscard]]
-    c7::defer lock() {
-	_lock();
-	return c7::defer([this](){ unlock(); });
+    lock_guard<condvar> lock() {
+	return lock_guard<condvar>(*this);
     }
 
     [[nodiscard]]
-    c7::defer trylock() {
-	if (_trylock()) {
-	    return c7::defer([this](){ unlock(); });
-	}
-	return c7::defer();
+    lock_guard<condvar> trylock() {
+	return lock_guard<condvar>::adopt(_trylock() ? this : nullptr);
     }
 
     void lock_do(std::function<void()> critical) {
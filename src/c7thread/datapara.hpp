@@ -14,35 +14,112 @@
 #include <c7common.hpp>
 
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #include <c7slice.hpp>
+#include <c7thread/barrier.hpp>
+#include <c7thread/ring_queue.hpp>
 #include <c7thread/thread.hpp>
-#include <c7thread/mask.hpp>
+#include <c7utils/time.hpp>
 
 
 namespace c7::thread::datapara {
 
 
-static inline constexpr int MAX_N_THREAD = 30;
-
-static inline constexpr uint64_t M_FINISH_REQ   = (1UL << 63);
-static inline constexpr uint64_t M_FINISHED_ANY = (1UL << 62);
-
-static inline constexpr uint64_t mask_start_req(int th_idx)
-{
-    return (1UL << (th_idx * 2 + 0));
-}
-
-static inline constexpr uint64_t mask_paused(int th_idx)
-{
-    return (1UL << (th_idx * 2 + 1));
-}
+// How items of a round are distributed to main_process threads.
+//
+// INTERLEAVE: item i is processed by thread (i % n_thread).
+// STATIC:     contiguous block of (n / n_thread) items per thread.
+// GUIDED:     threads claim chunks of (remaining / (2 * n_thread)) items, but
+//             at least grain items.
+// DYNAMIC:    threads claim chunks of grain items.
+//
+// STATIC/GUIDED/DYNAMIC avoid false sharing of adjacent output items, and
+// GUIDED/DYNAMIC also balance skewed per-item cost.
+enum class schedule {
+    INTERLEAVE, STATIC, GUIDED, DYNAMIC,
+};
 
 
 struct configure {
     int mt_threshold;
     int n_thread;
     size_t n_item_per_thread;
+    schedule sched = schedule::STATIC;
+    size_t grain = 0;			// GUIDED/DYNAMIC (0: decided by driver)
+    int n_inflight = 1;			// batches handed over to post_process (>1: pipelined, max:64)
+};
+
+
+class scheduler {
+public:
+    void init(const configure& cfg) {
+	sched_ = cfg.sched;
+	grain_ = cfg.grain;
+	if (grain_ == 0) {
+	    grain_ = std::max<size_t>(1, cfg.n_item_per_thread / 16);
+	}
+    }
+
+    // called before main_process threads are resumed
+    void reset() {
+	cursor_.store(0, std::memory_order_relaxed);
+    }
+
+    // call func(i) for each index assigned to th_idx, and return number of them.
+    template <typename Func>
+    size_t run(int th_idx, int n_thread, size_t n, Func func) {
+	size_t count = 0;
+	switch (sched_) {
+	case schedule::INTERLEAVE:
+	    for (size_t i = th_idx; i < n; i += n_thread) {
+		func(i);
+		count++;
+	    }
+	    break;
+
+	case schedule::STATIC: {
+		size_t block = (n + n_thread - 1) / n_thread;
+		size_t beg = std::min(n, block * th_idx);
+		size_t end = std::min(n, beg + block);
+		for (size_t i = beg; i < end; i++) {
+		    func(i);
+		}
+		count = end - beg;
+	    }
+	    break;
+
+	case schedule::GUIDED:
+	case schedule::DYNAMIC:
+	    for (;;) {
+		size_t beg = cursor_.load(std::memory_order_relaxed);
+		size_t chunk;
+		do {
+		    if (beg >= n) {
+			return count;
+		    }
+		    chunk = grain_;
+		    if (sched_ == schedule::GUIDED) {
+			chunk = std::max(chunk, (n - beg) / (2 * n_thread));
+		    }
+		    chunk = std::min(chunk, n - beg);
+		} while (!cursor_.compare_exchange_weak(beg, beg + chunk,
+							std::memory_order_relaxed));
+		for (size_t i = beg; i < beg + chunk; i++) {
+		    func(i);
+		}
+		count += chunk;
+	    }
+	    break;
+	}
+	return count;
+    }
+
+private:
+    schedule sched_ = schedule::STATIC;
+    size_t grain_ = 1;
+    alignas(64) std::atomic<size_t> cursor_ {0};
 };
 
 
@@ -52,7 +129,8 @@ public:
     driver_for_main() {}
 
 protected:
-    void init(size_t max_items) {
+    void init(const configure& cfg, size_t max_items) {
+	sched_.init(cfg);
 	in_items_.reserve(max_items);
 	in_items_.clear();
 	out_items_.reserve(max_items);
@@ -61,20 +139,21 @@ protected:
 
     void swap_rcv(std::vector<ItemIn>& rcv_items) {
 	std::swap(rcv_items, in_items_);
+	out_items_.resize(in_items_.size());
+	sched_.reset();
     }
 
     bool is_empty() {
 	return in_items_.empty();
     }
 
-    void apply_main_process(int th_idx, int n_thread) {
-	size_t n = in_items_.size();
-	out_items_.resize(n);
-	for (size_t i = th_idx; i < n; i += n_thread) {
-	    static_cast<Derived*>(this)->datapara_main_process(th_idx,
-							       in_items_[i],
-							       out_items_[i]);
-	}
+    size_t apply_main_process(int th_idx, int n_thread) {
+	return sched_.run(th_idx, n_thread, in_items_.size(),
+			  [this, th_idx](size_t i) {
+			      static_cast<Derived*>(this)->datapara_main_process(th_idx,
+										 in_items_[i],
+										 out_items_[i]);
+			  });
     }
 
     void swap_snd(std::vector<ItemOut>& snd_items) {
@@ -82,6 +161,7 @@ protected:
     }
 
 private:
+    scheduler sched_;
     std::vector<ItemIn> in_items_;
     std::vector<ItemOut> out_items_;
 };
@@ -93,7 +173,8 @@ public:
     driver_for_main() {}
 
 protected:
-    void init(size_t max_items) {
+    void init(const configure& cfg, size_t max_items) {
+	sched_.init(cfg);
 	items_.reserve(max_items);
 	items_.clear();
     }
@@ -104,14 +185,15 @@ protected:
 
     void swap_rcv(std::vector<Item>& rcv_items) {
 	std::swap(rcv_items, items_);
+	sched_.reset();
     }
 
-    void apply_main_process(int th_idx, int n_thread) {
-	size_t n = items_.size();
-	for (size_t i = th_idx; i < n; i += n_thread) {
-	    static_cast<Derived*>(this)->datapara_main_process(th_idx,
-							       items_[i]);
-	}
+    size_t apply_main_process(int th_idx, int n_thread) {
+	return sched_.run(th_idx, n_thread, items_.size(),
+			  [this, th_idx](size_t i) {
+			      static_cast<Derived*>(this)->datapara_main_process(th_idx,
+										 items_[i]);
+			  });
     }
 
     void swap_snd(std::vector<Item>& snd_items) {
@@ -119,6 +201,7 @@ protected:
     }
 
 private:
+    scheduler sched_;
     std::vector<Item> items_;
 };
 
@@ -147,20 +230,42 @@ public:
 private:
     size_t max_items_;
     std::vector<ItemIn> rcv_items_;
-    std::vector<ItemOut> snd_items_;
 
-    c7::thread::mask sync_mask_{0};
+    // round synchronization
+    //
+    //   start_bar_ : main threads + caller. caller arrives to start main phase.
+    //   main_bar_  : main threads + caller. completion hands over result to
+    //                post thread, and caller waits it in wait_process().
+    //   post_que_  : batches handed over to post thread (FIFO).
+    //   free_que_  : n_inflight buffers which are not in post_que_ nor in
+    //                post process. hand over waits here if all are in flight,
+    //                so that caller, main threads and post thread run
+    //                concurrently on different batches.
+    c7::thread::barrier start_bar_;
+    c7::thread::barrier main_bar_;
+    c7::thread::barrier::token_t main_token_;
+    bool main_busy_;			// caller side
+    static constexpr int MAX_N_INFLIGHT = 64;
+    int n_inflight_;
+    c7::thread::ring_queue<std::vector<ItemOut>, MAX_N_INFLIGHT> post_que_;
+    c7::thread::ring_queue<std::vector<ItemOut>, MAX_N_INFLIGHT> free_que_;
+    std::atomic<bool> finish_req_;
 
     int main_n_thread_;
     std::vector<c7::thread::thread> ths_;
 
-    uint64_t m_all_paused_;		// include post_thread
-    uint64_t m_allmain_start_req_;	// exclude post_thread
-    uint64_t m_allmain_paused_;		// exclude post_thread
-    size_t   main_mt_threshold_;
+    struct alignas(64) thread_stats {
+	uint64_t n_round;
+	uint64_t n_item;
+	int64_t busy_ns;
+    };
+    std::vector<thread_stats> stats_;
 
     c7::result<> wait_process();
     void resume_process();
+    c7::result<> wait_post();
+    void hand_over_post();
+    void abort_all();
     void main_thread(const int th_idx);
     void post_thread(const int th_idx);
     const char *name() {
@@ -179,27 +284,28 @@ template <typename Derived, typename ItemIn, typename ItemOut>
 void
 driver<Derived, ItemIn, ItemOut>::init(const configure& cfg)
 {
-    main_n_thread_     = std::min(cfg.n_thread, MAX_N_THREAD);
-    main_mt_threshold_ = cfg.mt_threshold * main_n_thread_;
+    main_n_thread_     = std::max(cfg.n_thread, 1);
 
     max_items_ = cfg.n_item_per_thread * main_n_thread_;
     rcv_items_.reserve(max_items_);
     rcv_items_.clear();
-    snd_items_.reserve(max_items_);
-    snd_items_.clear();
-
-    driver_base::init(max_items_);
 
-    m_allmain_start_req_ = 0;
-    m_allmain_paused_	 = 0;
-    for (int i = 0; i < main_n_thread_; i++) {
-	m_allmain_start_req_ |= mask_start_req(i);
-	m_allmain_paused_    |= mask_paused(i);
+    driver_base::init(cfg, max_items_);
+    stats_.assign(main_n_thread_, thread_stats{});
+
+    start_bar_.reset(main_n_thread_ + 1);
+    main_bar_.reset(main_n_thread_ + 1, [this](){ hand_over_post(); });
+    main_busy_ = false;
+    finish_req_ = false;
+
+    n_inflight_ = std::clamp(cfg.n_inflight, 1, MAX_N_INFLIGHT);
+    post_que_.reset();
+    free_que_.reset();
+    for (int i = 0; i < n_inflight_; i++) {
+	std::vector<ItemOut> buf;
+	buf.reserve(max_items_);
+	(void)free_que_.put(std::move(buf));
     }
-    m_all_paused_    = (m_allmain_paused_ |
-			mask_paused(main_n_thread_));	// for post_thread
-
-    sync_mask_.clear();
 
     ths_.clear();
     for (int i = 0; i < main_n_thread_; i++) {
@@ -250,7 +356,7 @@ driver<Derived, ItemIn, ItemOut>::end_round()
 	res << wait_process();
     }
     if (res) {
-	sync_mask_.wait_all(m_all_paused_, 0);
+	res << wait_post();
     }
     return res;
 }
@@ -260,12 +366,22 @@ template <typename Derived, typename ItemIn, typename ItemOut>
 void
 driver<Derived, ItemIn, ItemOut>::end()
 {
-    sync_mask_.on(M_FINISH_REQ);
+    finish_req_ = true;
+    if (wait_process() && wait_post()) {
+	(void)start_bar_.arrive();
+	post_que_.close();
+    }
     for (auto& th: ths_) {
 	th.join();
 	logger(__FILE__, __LINE__, C7_LOG_DTL,
 	       "%{}::end: %{} is joined", name(), th.name());
     }
+    for (int i = 0; i < main_n_thread_; i++) {
+	auto& st = stats_[i];
+	logger(__FILE__, __LINE__, C7_LOG_INF,
+	       "%{}::end: main_process#%{}: round:%{}, item:%{}, busy:%{}us",
+	       name(), i, st.n_round, st.n_item, st.busy_ns / 1000);
+    }
 }
 
 
@@ -273,13 +389,14 @@ template <typename Derived, typename ItemIn, typename ItemOut>
 c7::result<>
 driver<Derived, ItemIn, ItemOut>::wait_process()
 {
-    const uint64_t m_except = M_FINISHED_ANY;
-    uint64_t ret = sync_mask_.wait_all_or(m_allmain_paused_, m_except, 0);
-    if ((ret & m_except) != 0) {
-	logger(__FILE__, __LINE__, C7_LOG_INF,
-	       "%{}::wait_process: detect M_FINISHED_ANY (unexpectedly)", name());
-	return c7result_err(EFAULT, "%{}::wait_process: som post_thread is unexpectedly finished.",
-			    name());
+    if (main_busy_) {
+	main_busy_ = false;
+	if (!main_bar_.wait(main_token_)) {
+	    logger(__FILE__, __LINE__, C7_LOG_INF,
+		   "%{}::wait_process: detect barrier abort (unexpectedly)", name());
+	    return c7result_err(EFAULT, "%{}::wait_process: some thread is unexpectedly finished.",
+				name());
+	}
     }
     return c7result_ok();
 }
@@ -289,109 +406,130 @@ template <typename Derived, typename ItemIn, typename ItemOut>
 void
 driver<Derived, ItemIn, ItemOut>::resume_process()
 {
-    // resume main_thread
+    // resume main_thread (all main_thread has finished previous round)
     driver_base::swap_rcv(rcv_items_);
-    sync_mask_.off(m_allmain_paused_);		// (A) [IMPORTANT]
-    sync_mask_.on(m_allmain_start_req_);
-    // make sure all main_thread has been resumed.
-    sync_mask_.wait_alloff(m_allmain_start_req_, 0);
+    (void)start_bar_.arrive();
+    main_token_ = main_bar_.arrive();
+    main_busy_ = true;
 
     rcv_items_.clear();
 }
 
 
+// wait all handed over batches are post processed (called after wait_process())
+template <typename Derived, typename ItemIn, typename ItemOut>
+c7::result<>
+driver<Derived, ItemIn, ItemOut>::wait_post()
+{
+    std::vector<std::vector<ItemOut>> bufs;
+    for (int i = 0; i < n_inflight_; i++) {
+	auto res = free_que_.get();
+	if (!res) {
+	    return c7result_err(EFAULT, "%{}::wait_post: some thread is unexpectedly finished.",
+				name());
+	}
+	bufs.push_back(std::move(res.value()));
+    }
+    for (auto& buf: bufs) {
+	(void)free_que_.put(std::move(buf));
+    }
+    return c7result_ok();
+}
+
+
+// completion of main_bar_: called by the last arriver (main_thread or caller)
 template <typename Derived, typename ItemIn, typename ItemOut>
 void
-driver<Derived, ItemIn, ItemOut>::main_thread(const int th_idx)
+driver<Derived, ItemIn, ItemOut>::hand_over_post()
 {
-    c7::defer on_exit{[this, th_idx]() {
-			  uint64_t m = (M_FINISHED_ANY|
-					mask_paused(th_idx));
-			  sync_mask_.on(m);
-		      }};
+    if (driver_base::is_empty()) {
+	return;
+    }
+    // wait a buffer which is not in flight
+    auto res = free_que_.get();
+    if (!res) {
+	return;
+    }
+    auto buf = std::move(res.value());
+    driver_base::swap_snd(buf);
+    (void)post_que_.put(std::move(buf));
+}
 
-    const uint64_t m_my_start_req = mask_start_req(th_idx);
-    const uint64_t m_my_paused	  = mask_paused(th_idx);
-    const uint64_t m_except	  = M_FINISH_REQ|M_FINISHED_ANY;
 
-    const int      snd_idx         = main_n_thread_;
-    const uint64_t m_snd_start_req = mask_start_req(snd_idx);
-    const uint64_t m_snd_paused    = mask_paused(snd_idx);
+template <typename Derived, typename ItemIn, typename ItemOut>
+void
+driver<Derived, ItemIn, ItemOut>::abort_all()
+{
+    start_bar_.abort();
+    main_bar_.abort();
+    post_que_.abort();
+    free_que_.abort();
+}
 
-    const uint64_t m_wait_others = (m_allmain_paused_ & ~m_my_paused) | m_snd_paused;
+
+template <typename Derived, typename ItemIn, typename ItemOut>
+void
+driver<Derived, ItemIn, ItemOut>::main_thread(const int th_idx)
+{
+    c7::scope_guard on_exit{[this]() {
+			  if (!finish_req_) {
+			      abort_all();
+			  }
+		      }};
 
     for (;;) {
-	sync_mask_.on(m_my_paused);
-	uint64_t ret = sync_mask_.wait_any(m_my_start_req|m_except,
-					   m_my_start_req|m_my_paused);	// clear at return
-	if ((ret & m_except) != 0) {
-	    auto what = (ret & M_FINISH_REQ) ? "M_FINISH_REQ" : "M_FINISHED_ANY";
+	if (!start_bar_.arrive_and_wait() || finish_req_) {
+	    auto what = finish_req_ ? "finish request" : "barrier abort";
 	    logger(__FILE__, __LINE__, C7_LOG_INF, "%{}::main_thread#%{}: detect %{}",
 		   name(), th_idx, what);
 	    return;
 	}
 
-	if (driver_base::is_empty()) {
-	    continue;
-	}
+	auto beg_ns = c7::monotonic_ns();
+	auto n = driver_base::apply_main_process(th_idx, main_n_thread_);
+	auto& st = stats_[th_idx];
+	st.busy_ns += c7::monotonic_ns() - beg_ns;
+	st.n_item += n;
+	st.n_round++;
 
-	driver_base::apply_main_process(th_idx, main_n_thread_);
-
-	if (th_idx == 0) {
-	    // wait all other main_thread and post_thread are paused.
-	    ret = sync_mask_.wait_all_or(m_wait_others, m_except, 0);
-	    // It's guranteed that all main_thread has been run and paused.
-	    // by calling sync_mask_.off(ma_allmain_paused_) on resume_process (A).
-
-	    if ((ret & m_except) != 0) {
-		auto what = (ret & M_FINISH_REQ) ? "M_FINISH_REQ" : "M_FINISHED_ANY";
-		logger(__FILE__, __LINE__, C7_LOG_INF, "%{}::main_thread#%{}: detect %{}",
-		       name(), th_idx, what);
-		return;
-	    }
-
-	    // resume post_thread
-	    driver_base::swap_snd(snd_items_);
-	    sync_mask_.on(m_snd_start_req);
-	    // make sure post_thread has been resumed.
-	    sync_mask_.wait_alloff(m_snd_start_req, 0);
-	}
+	// The last arriver hands over result to post_thread.
+	(void)main_bar_.arrive();
     }
 }
 
 
 template <typename Derived, typename ItemIn, typename ItemOut>
 void
-driver<Derived, ItemIn, ItemOut>::post_thread(const int th_idx)
+driver<Derived, ItemIn, ItemOut>::post_thread(const int)
 {
-    const uint64_t m_my_start_req = mask_start_req(th_idx);
-    const uint64_t m_my_paused = mask_paused(th_idx);
-    const uint64_t m_except = M_FINISH_REQ|M_FINISHED_ANY;
-
-    c7::defer on_exit{[this, th_idx]() {
-			  uint64_t m = (M_FINISHED_ANY|
-					mask_paused(th_idx));
-			  sync_mask_.on(m);
+    c7::scope_guard on_exit{[this]() {
+			  if (!finish_req_) {
+			      abort_all();
+			  }
 		      }};
 
     for (;;) {
-	sync_mask_.on(m_my_paused);
-	uint64_t ret = sync_mask_.wait_any(m_my_start_req|m_except, m_my_start_req|m_my_paused);
-	if ((ret & m_except) != 0) {
-	    auto what = (ret & M_FINISH_REQ) ? "M_FINISH_REQ" : "M_FINISHED_ANY";
+	auto res = post_que_.get();
+	if (!res) {
+	    auto what = finish_req_ ? "finish request" : "queue abort";
 	    logger(__FILE__, __LINE__, C7_LOG_INF, "%{}::post_thread  : detect %{}",
 		   name(), what);
 	    return;
 	}
+	auto snd_items = std::move(res.value());
 
 	if constexpr (std::is_invocable_v<decltype(&Derived::datapara_post_process), Derived, ItemOut&>) {
-	    for (auto& data: snd_items_) {
+	    for (auto& data: snd_items) {
 		static_cast<Derived*>(this)->datapara_post_process(data);
 	    }
 	} else {
-	    auto slice = c7::make_slice(snd_items_.data(), snd_items_.size());
+	    auto slice = c7::make_slice(snd_items.data(), snd_items.size());
 	    static_cast<Derived*>(this)->datapara_post_process(slice);
 	}
+
+	if (!free_que_.put(std::move(snd_items))) {
+	    return;
+	}
     }
 }
 
@@ -0,0 +1,214 @@
+/*
+ * c7thread/fastlock.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google spreadsheets:
+ * (Nothing)
+ */
+#ifndef C7_THREAD_FASTLOCK_HPP_LOADED_
+#define C7_THREAD_FASTLOCK_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7thread/futex.hpp>
+#include <c7thread/lock_guard.hpp>
+#include <atomic>
+#include <sched.h>
+
+
+namespace c7::thread {
+
+
+// inline lock types
+// -----------------
+//
+// - ttas_spinlock:  test-and-test-and-set with exponential backoff.
+// - ticket_lock:    FIFO fair spinlock. (handover costs a context switch if
+//                   waiters outnumber CPUs)
+// - adaptive_mutex: spin a while, then sleep on futex.
+//
+// All of them are header only, allocation free, and have same interface as
+// c7::thread::mutex and c7::thread::spinlock (_lock, _trylock, unlock, lock,
+// trylock, lock_do, trylock_do). So they can be used as mpool Locker etc.
+// (They can't be used with c7::thread::condvar.)
+
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+
+template <typename Lock>
+class fastlock_base {
+public:
+    [[nodiscard]]
+    lock_guard<Lock> lock() {
+	return lock_guard<Lock>(*static_cast<Lock*>(this));
+    }
+
+    [[nodiscard]]
+    lock_guard<Lock> trylock() {
+	auto self = static_cast<Lock*>(this);
+	return lock_guard<Lock>::adopt(self->_trylock() ? self : nullptr);
+    }
+
+    template <typename F>
+    auto lock_do(F critical) {
+	auto unlock = lock();
+	return critical();
+    }
+
+    template <typename F>
+    bool trylock_do(F critical) {
+	auto unlock = trylock();
+	if (unlock) {
+	    critical();
+	}
+	return static_cast<bool>(unlock);
+    }
+};
+
+
+class ttas_spinlock: public fastlock_base<ttas_spinlock> {
+public:
+    ttas_spinlock(const ttas_spinlock&) = delete;
+    ttas_spinlock& operator=(const ttas_spinlock&) = delete;
+
+    ttas_spinlock() = default;
+
+    void _lock() {
+	unsigned delay = 1;
+	while (locked_.exchange(true, std::memory_order_acquire)) {
+	    while (locked_.load(std::memory_order_relaxed)) {
+		for (unsigned i = 0; i < delay; i++) {
+		    cpu_relax();
+		}
+		if (delay < max_delay) {
+		    delay <<= 1;
+		} else {
+		    sched_yield();
+		}
+	    }
+	}
+    }
+
+    bool _trylock() {
+	return (!locked_.load(std::memory_order_relaxed) &&
+		!locked_.exchange(true, std::memory_order_acquire));
+    }
+
+    void unlock() {
+	locked_.store(false, std::memory_order_release);
+    }
+
+private:
+    static constexpr unsigned max_delay = 1024;
+    std::atomic<bool> locked_ {false};
+};
+
+
+class ticket_lock: public fastlock_base<ticket_lock> {
+public:
+    ticket_lock(const ticket_lock&) = delete;
+    ticket_lock& operator=(const ticket_lock&) = delete;
+
+    ticket_lock() = default;
+
+    void _lock() {
+	auto my = next_.fetch_add(1, std::memory_order_relaxed);
+	uint32_t spent = 0;
+	for (;;) {
+	    auto cur = serving_.load(std::memory_order_acquire);
+	    if (cur == my) {
+		return;
+	    }
+	    // proportional backoff: wait longer if many are ahead. yield if the
+	    // holder (or the next one) seems to be preempted.
+	    auto delay = (my - cur) * 16;
+	    if (spent > max_spin || delay > max_spin) {
+		sched_yield();
+	    } else {
+		for (uint32_t i = 0; i < delay; i++) {
+		    cpu_relax();
+		}
+		spent += delay;
+	    }
+	}
+    }
+
+    bool _trylock() {
+	auto cur = serving_.load(std::memory_order_acquire);
+	auto expect = cur;
+	return next_.compare_exchange_strong(expect, cur + 1, std::memory_order_acquire,
+					     std::memory_order_relaxed);
+    }
+
+    void unlock() {
+	serving_.store(serving_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    static constexpr uint32_t max_spin = 128;	// cpu_relax() before yield
+    alignas(64) std::atomic<uint32_t> next_ {0};
+    alignas(64) std::atomic<uint32_t> serving_ {0};
+};
+
+
+// U.Drepper, "Futexes Are Tricky": state 0: unlocked, 1: locked, 2: locked and
+// there may be waiters.
+class adaptive_mutex: public fastlock_base<adaptive_mutex> {
+public:
+    adaptive_mutex(const adaptive_mutex&) = delete;
+    adaptive_mutex& operator=(const adaptive_mutex&) = delete;
+
+    adaptive_mutex() = default;
+
+    void _lock() {
+	for (int i = 0; i < spin_count; i++) {
+	    uint32_t expect = 0;
+	    if (state_.compare_exchange_weak(expect, 1, std::memory_order_acquire,
+					     std::memory_order_relaxed)) {
+		return;
+	    }
+	    if (expect == 2) {
+		break;			// others are already sleeping
+	    }
+	    cpu_relax();
+	}
+	while (state_.exchange(2, std::memory_order_acquire) != 0) {
+	    (void)futex_wait(state_, 2);
+	}
+    }
+
+    bool _trylock() {
+	uint32_t expect = 0;
+	return state_.compare_exchange_strong(expect, 1, std::memory_order_acquire,
+					      std::memory_order_relaxed);
+    }
+
+    void unlock() {
+	if (state_.exchange(0, std::memory_order_release) == 2) {
+	    futex_wake(state_);
+	}
+    }
+
+private:
+    static constexpr int spin_count = 100;
+    std::atomic<uint32_t> state_ {0};
+};
+
+
+} // namespace c7::thread
+
+
+#endif // c7thread/fastlock.hpp
@@ -0,0 +1,72 @@
+/*
+ * c7thread/futex.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google spreadsheets:
+ * (Nothing)
+ */
+#ifndef C7_THREAD_FUTEX_HPP_LOADED_
+#define C7_THREAD_FUTEX_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <atomic>
+#include <climits>
+#include <cerrno>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+namespace c7::thread {
+
+
+// thin wrapper of futex(2) (process private)
+// ------------------------------------------
+//
+// - futex_wait() sleeps while word == expected. timeout_abs is CLOCK_REALTIME
+//   (same as c7::mktimespec), nullptr means no timeout.
+// - futex_wait() returns false only on timeout. Spurious wakeup is possible,
+//   so the caller must recheck its condition.
+// - bitset of futex_wait() and futex_wake_bitset() selects waiters: a waiter is
+//   woken only if its bitset and waker's bitset have common bits (non zero).
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+
+inline bool futex_wait(std::atomic<uint32_t>& word, uint32_t expected,
+		       const ::timespec *timeout_abs = nullptr,
+		       uint32_t bitset = FUTEX_BITSET_MATCH_ANY)
+{
+    auto ret = ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word),
+			 FUTEX_WAIT_BITSET_PRIVATE | FUTEX_CLOCK_REALTIME,
+			 expected, timeout_abs, nullptr, bitset);
+    return !(ret == -1 && errno == ETIMEDOUT);
+}
+
+inline void futex_wake(std::atomic<uint32_t>& word, int n = 1)
+{
+    (void)::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word),
+		    FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+}
+
+inline void futex_wake_all(std::atomic<uint32_t>& word)
+{
+    futex_wake(word, INT_MAX);
+}
+
+inline void futex_wake_bitset(std::atomic<uint32_t>& word, uint32_t bitset, int n = INT_MAX)
+{
+    (void)::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word),
+		    FUTEX_WAKE_BITSET_PRIVATE, n, nullptr, nullptr, bitset);
+}
+
+
+} // namespace c7::thread
+
+
+#endif // c7thread/futex.hpp
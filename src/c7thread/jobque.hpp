@@ -15,6 +15,7 @@
 
 
 #include <c7thread/_queue.hpp>
+#include <c7utils/chunk_ring.hpp>
 
 
 namespace c7::thread {
@@ -22,7 +23,7 @@ namespace c7::thread {
 
 template <typename T,
 	  template <typename, typename = std::allocator<T>>
-	  class Container = std::list>
+	  class Container = c7::chunk_ring>
 class jobque: public queue_base<T, jobque<T, Container>> {
 private:
     using base_type = queue_base<T, jobque<T, Container>>;
@@ -43,11 +44,12 @@ private:
 	return (uncommitted_jobs_ == 0);
     }
 
-    c7::result<> commit_job(size_t) {
-	if (uncommitted_jobs_ == 0) {
-	    return c7result_err(EINVAL, "Invalid commit: no uncommitted jobs");
+    c7::result<> commit_job(size_t n) {
+	if (uncommitted_jobs_ < n) {
+	    return c7result_err(EINVAL, "Invalid commit: uncommitted jobs:%{} < %{}",
+				uncommitted_jobs_, n);
 	}
-	uncommitted_jobs_--;
+	uncommitted_jobs_ -= n;
 	return c7result_ok();
     }
 
@@ -85,8 +87,25 @@ public:
 	return base_type::get(weight, tmo_us);
     }
 
-    c7::result<> commit() {
-	return base_type::commit(1);
+    // move all items of range, return number of put items.
+    template <typename Range>
+    c7::result<size_t> put_n(Range&& items, c7::usec_t tmo_us = -1) {
+	return base_type::put_n(std::begin(items), std::end(items),
+				[](auto&) { return 1; },
+				[](auto& item) -> T&& { return std::move(item); },
+				tmo_us);
+    }
+
+    // get 1 .. max_n items (wait only if empty), return number of got items.
+    // Each item must be committed (commit(n) is allowed).
+    template <typename OutputIt>
+    c7::result<size_t> get_n(OutputIt out, size_t max_n, c7::usec_t tmo_us = -1) {
+	return base_type::get_n([&out](T&& item, size_t) { *out++ = std::move(item); },
+				max_n, tmo_us);
+    }
+
+    c7::result<> commit(size_t n = 1) {
+	return base_type::commit(n);
     }
 
     using base_type::wait_finished;
@@ -95,7 +114,7 @@ public:
 
 template <typename T,
 	  template <typename, typename = std::allocator<std::pair<T, size_t>>>
-	  class Container = std::list>
+	  class Container = c7::chunk_ring>
 class weight_jobque: public queue_base<T, weight_jobque<T, Container>> {
 private:
     using base_type = queue_base<T, weight_jobque<T, Container>>;
@@ -175,6 +194,24 @@ public:
 	return c7result_ok(uncommitted_);
     }
 
+    // move all (item, weight) pairs of range, return number of put items.
+    template <typename Range>
+    c7::result<size_t> put_n(Range&& items, c7::usec_t tmo_us = -1) {
+	return base_type::put_n(std::begin(items), std::end(items),
+				[](auto& iw) -> size_t { return iw.second; },
+				[](auto& iw) -> T&& { return std::move(iw.first); },
+				tmo_us);
+    }
+
+    // get 1 .. max_n (item, weight) pairs (wait only if empty), return number of
+    // got items.
+    template <typename OutputIt>
+    c7::result<size_t> get_n(OutputIt out, size_t max_n, c7::usec_t tmo_us = -1) {
+	return base_type::get_n([&out](T&& item, size_t weight) {
+		*out++ = std::pair<T, size_t>(std::move(item), weight);
+	    }, max_n, tmo_us);
+    }
+
     using base_type::put;
     using base_type::get;
     using base_type::commit;
@@ -0,0 +1,100 @@
+/*
+ * c7thread/lock_guard.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google spreadsheets:
+ * (Nothing)
+ */
+#ifndef C7_THREAD_LOCK_GUARD_HPP_LOADED_
+#define C7_THREAD_LOCK_GUARD_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7defer.hpp>
+#include <utility>
+
+
+namespace c7::thread {
+
+
+// RAII guard of Lock which has _lock(), _trylock() and unlock()
+// -------------------------------------------------------------
+//
+// - Returned by lock() and trylock() of mutex, spinlock, condvar and the types
+//   in c7thread/fastlock.hpp.
+// - Same usage as c7::defer which was returned by lock() formerly: unlocked by
+//   destructor or by operator()(), and operator bool tells whether the lock is
+//   held (trylock).
+// - Only a pointer is held, so no allocation and no type erasure.
+// - It can be converted to c7::defer for the interface which returns c7::defer.
+
+template <typename Lock>
+class [[nodiscard]] lock_guard {
+public:
+    lock_guard(const lock_guard&) = delete;
+    lock_guard& operator=(const lock_guard&) = delete;
+
+    lock_guard() = default;
+
+    explicit lock_guard(Lock& lock): lock_(&lock) {
+	lock._lock();
+    }
+
+    // lock is already acquired (or nullptr)
+    static lock_guard adopt(Lock *locked) {
+	lock_guard g;
+	g.lock_ = locked;
+	return g;
+    }
+
+    lock_guard(lock_guard&& o): lock_(std::exchange(o.lock_, nullptr)) {}
+
+    lock_guard& operator=(lock_guard&& o) {
+	if (this != &o) {
+	    (*this)();
+	    lock_ = std::exchange(o.lock_, nullptr);
+	}
+	return *this;
+    }
+
+    ~lock_guard() {
+	if (lock_ != nullptr) {
+	    lock_->unlock();
+	}
+    }
+
+    void operator()() {
+	if (lock_ != nullptr) {
+	    lock_->unlock();
+	    lock_ = nullptr;
+	}
+    }
+
+    explicit operator bool() const {
+	return (lock_ != nullptr);
+    }
+
+    void cancel() {
+	lock_ = nullptr;
+    }
+
+    operator c7::defer() && {
+	if (auto lock = std::exchange(lock_, nullptr); lock != nullptr) {
+	    return c7::defer([lock](){ lock->unlock(); });
+	}
+	return c7::defer();
+    }
+
+private:
+    Lock *lock_ = nullptr;
+};
+
+
+} // namespace c7::thread
+
+
+#endif // c7thread/lock_guard.hpp
@@ -14,16 +14,98 @@
 #include <c7common.hpp>
 
 
-#include <c7thread/condvar.hpp>
+#include <c7utils/time.hpp>
+#include <c7thread/futex.hpp>
+#include <atomic>
+#include <functional>
+#include <sched.h>
 
 
 namespace c7::thread {
 
 
+// 64 bits event flags
+// -------------------
+//
+// - Bits are kept in an atomic word, so on(), off(), change() and wait*() that
+//   is satisfied immediately don't lock and don't call system call if nobody
+//   is waiting.
+// - A waiter sleeps on futex with the bitset folded from the bits which its
+//   condition depends on (e.g. expect_allon of wait_all), and a waker wakes
+//   only the waiters whose bitset has common bits with changed bits. (bit i and
+//   bit i+32 share same futex bit)
+// - Functions given to change() and wait() may be called more than once, so
+//   they must only compute new value from in_out.
+
 class mask {
 private:
-    condvar c_;
-    uint64_t mask_;
+    alignas(64) std::atomic<uint64_t> mask_;
+    alignas(64) std::atomic<uint32_t> seq_ {0};	// futex word
+    std::atomic<uint32_t> n_waiting_ {0};
+
+    static constexpr int spin_count = 16;	// sched_yield() before futex wait
+
+    static uint32_t fold(uint64_t bits) {
+	return static_cast<uint32_t>(bits | (bits >> 32));
+    }
+
+    void notify(uint64_t old_mask, uint64_t new_mask) {
+	// seq_cst: pairs with n_waiting_ and mask_ in wait_()
+	if (old_mask != new_mask && n_waiting_.load() != 0) {
+	    seq_.fetch_add(1, std::memory_order_release);
+	    futex_wake_bitset(seq_, fold(old_mask ^ new_mask));
+	}
+    }
+
+    template <typename F>
+    bool change_(F func) {
+	auto cur = mask_.load();
+	for (;;) {
+	    auto m = cur;
+	    func(m);
+	    if (m == cur) {
+		return false;
+	    }
+	    if (mask_.compare_exchange_weak(cur, m)) {
+		notify(cur, m);
+		return true;
+	    }
+	}
+    }
+
+    // interest: bits which func depends on (0: unknown)
+    template <typename F>
+    uint64_t wait_(uint64_t interest, F func, c7::usec_t timeout) {
+	auto bitset = (interest == 0) ? FUTEX_BITSET_MATCH_ANY : fold(interest);
+	::timespec abstime, *abstime_p = nullptr;
+	if (timeout >= 0) {
+	    abstime = *c7::mktimespec(timeout);
+	    abstime_p = &abstime;
+	}
+	for (int i = 0;; i++) {
+	    auto seq = seq_.load(std::memory_order_acquire);
+	    auto cur = mask_.load();
+	    for (;;) {
+		auto m = cur;
+		if (auto ret = func(m); ret == 0) {
+		    break;
+		} else if (m == cur || mask_.compare_exchange_weak(cur, m)) {
+		    notify(cur, m);
+		    return ret;
+		}
+	    }
+	    if (i < spin_count && timeout != 0) {
+		sched_yield();
+		continue;
+	    }
+	    n_waiting_.fetch_add(1);
+	    bool ok = (mask_.load() != cur) || futex_wait(seq_, seq, abstime_p, bitset);
+	    n_waiting_.fetch_sub(1);
+	    if (!ok) {
+		return 0;
+	    }
+	}
+    }
 
 public:
     mask(const mask&) = delete;
@@ -31,17 +113,31 @@ public:
     mask& operator=(const mask&) = delete;
     mask& operator=(mask&&) = delete;
 
-    explicit mask(uint64_t ini_mask);
+    explicit mask(uint64_t ini_mask): mask_(ini_mask) {}
+
+    uint64_t get() const {
+	return mask_.load();
+    }
+
+    void clear() {
+	notify(mask_.exchange(0), 0);
+    }
+
+    void on(uint64_t on_mask) {
+	auto old_mask = mask_.fetch_or(on_mask);
+	notify(old_mask, old_mask | on_mask);
+    }
+
+    void off(uint64_t off_mask) {
+	auto old_mask = mask_.fetch_and(~off_mask);
+	notify(old_mask, old_mask & ~off_mask);
+    }
 
-    uint64_t get();
-    void clear();
-    void on(uint64_t on_mask);
-    void off(uint64_t off_mask);
     bool change(std::function<void(uint64_t& in_out)> func);
     uint64_t wait(std::function<uint64_t(uint64_t& in_out)> func, c7::usec_t timeout = -1);
 
     void change(uint64_t on_mask, uint64_t off_mask) {
-	change(
+	(void)change_(
 	    [on_mask,off_mask](uint64_t& in_out){
 		in_out = (in_out|on_mask) & ~off_mask;
 	    });
@@ -50,7 +146,8 @@ public:
     uint64_t wait_all(uint64_t expect_allon,
 		      uint64_t clear,
 		      c7::usec_t timeout = -1) {
-	return wait(
+	return wait_(
+	    expect_allon,
 	    [expect_allon,clear](uint64_t& in_out){
 		if ((expect_allon & in_out) == expect_allon) {
 		    in_out &= ~clear;
@@ -63,7 +160,8 @@ public:
     uint64_t wait_alloff(uint64_t expect_alloff,
 			 uint64_t clear,
 			 c7::usec_t timeout = -1) {
-	return wait(
+	return wait_(
+	    expect_alloff,
 	    [expect_alloff,clear](uint64_t& in_out){
 		if ((expect_alloff & in_out) == 0) {
 		    in_out &= ~clear;
@@ -77,7 +175,8 @@ public:
 			 uint64_t expect_anyon,
 			 uint64_t clear,
 			 c7::usec_t timeout = -1) {
-	return wait(
+	return wait_(
+	    expect_allon|expect_anyon,
 	    [expect_allon,expect_anyon,clear](uint64_t& in_out){
 		if ((expect_allon & in_out) == expect_allon ||
 		    (expect_anyon & in_out) != 0) {
@@ -93,7 +192,8 @@ public:
 			    uint64_t expect_anyon,
 			    uint64_t clear,
 			    c7::usec_t timeout = -1) {
-	return wait(
+	return wait_(
+	    expect_alloff|expect_anyon,
 	    [expect_alloff,expect_anyon,clear](uint64_t& in_out){
 		if ((expect_alloff & in_out) == 0 ||
 		    (expect_anyon  & in_out) != 0) {
@@ -108,7 +208,8 @@ public:
     uint64_t wait_any(uint64_t expect_anyon,
 		      uint64_t clear,
 		      c7::usec_t timeout = -1) {
-	return wait(
+	return wait_(
+	    expect_anyon,
 	    [expect_anyon,clear](uint64_t& in_out){
 		if ((expect_anyon & in_out) != 0) {
 		    uint64_t ret = (expect_anyon & in_out);
@@ -122,7 +223,8 @@ public:
     uint64_t wait_anyoff(uint64_t expect_anyoff,
 			 uint64_t clear,
 			 c7::usec_t timeout = -1) {
-	return wait(
+	return wait_(
+	    expect_anyoff,
 	    [expect_anyoff,clear](uint64_t& in_out){
 		if ((expect_anyoff & ~in_out) != 0) {
 		    uint64_t ret = (expect_anyoff & ~in_out);
@@ -137,7 +239,8 @@ public:
 			    uint64_t expect_anyon,
 			    uint64_t clear,
 			    c7::usec_t timeout = -1) {
-	return wait(
+	return wait_(
+	    expect_anyoff|expect_anyon,
 	    [expect_anyoff,expect_anyon,clear](uint64_t& in_out){
 		if ((expect_anyoff & ~in_out) != 0 ||
 		    (expect_anyon  & in_out) != 0) {
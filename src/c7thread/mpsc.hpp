@@ -0,0 +1,74 @@
+/*
+ * c7thread/mpsc.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google spreadsheets:
+ * (Nothing)
+ */
+#ifndef C7_THREAD_MPSC_HPP_LOADED_
+#define C7_THREAD_MPSC_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <atomic>
+
+
+namespace c7::thread {
+
+
+// intrusive lock-free MPSC queue
+// ------------------------------
+//
+// - Node must have a member `Node *next'.
+// - push() can be called by any threads, pop_all() must be called by single consumer.
+// - pop_all() take all pushed nodes at once, and return them in FIFO order.
+
+template <typename Node>
+class mpsc_queue {
+public:
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    mpsc_queue() = default;
+
+    // return true if queue was empty before push.
+    bool push(Node *node) {
+	auto head = head_.load(std::memory_order_relaxed);
+	do {
+	    node->next = head;
+	} while (!head_.compare_exchange_weak(head, node,
+					      std::memory_order_seq_cst,
+					      std::memory_order_relaxed));
+	return (head == nullptr);
+    }
+
+    Node *pop_all() {
+	auto node = head_.exchange(nullptr, std::memory_order_seq_cst);
+	// reverse LIFO list to FIFO order
+	Node *fifo = nullptr;
+	while (node != nullptr) {
+	    auto next = node->next;
+	    node->next = fifo;
+	    fifo = node;
+	    node = next;
+	}
+	return fifo;
+    }
+
+    bool empty() const {
+	return head_.load(std::memory_order_seq_cst) == nullptr;
+    }
+
+private:
+    std::atomic<Node*> head_ {nullptr};
+};
+
+
+} // namespace c7::thread
+
+
+#endif // c7thread/mpsc.hpp
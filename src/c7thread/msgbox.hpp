@@ -16,12 +16,13 @@
 
 #include <unistd.h>
 #include <atomic>
-#include <list>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 #include <c7hash.hpp>
 #include <c7result.hpp>
-#include <c7thread/condvar.hpp>
+#include <c7thread/fastlock.hpp>
+#include <c7thread/futex.hpp>
 #include <c7utils/time.hpp>
 
 
@@ -49,6 +50,16 @@ extern counter tray_id;
 }
 
 
+// message box of request/response trays
+// --------------------------------------
+//
+// - box is divided into shards by tray key, and each shard has its own lock.
+// - Each tray has its own futex word, so put() wakes only the threads waiting
+//   on that tray.
+// - wait() returns messages in a msg_batch (std::vector). wait(tray, batch)
+//   swaps the cleared buffer of batch into the tray, so that repeated
+//   request/response on a tray doesn't allocate in steady state.
+
 template <typename Msg>
 class msgbox {
 private:
@@ -57,6 +68,7 @@ private:
 
 public:
     using u64_key = c7::simple_wrap<uint64_t, msgbox<Msg>>;
+    using msg_batch = std::vector<Msg>;
 
     class tray_key {
     public:
@@ -118,14 +130,27 @@ public:
 	return pimpl_->reserve();
     }
 
-    c7::result<std::list<Msg>> wait(const tray_key& tray,
-				    const ::timespec* timeout_abs = nullptr) {
-	return pimpl_->wait(tray, timeout_abs);
+    c7::result<msg_batch> wait(const tray_key& tray,
+			       const ::timespec* timeout_abs = nullptr) {
+	msg_batch batch;
+	if (auto res = pimpl_->wait(tray, batch, timeout_abs); !res) {
+	    return res.as_error();
+	}
+	return c7result_ok(std::move(batch));
+    }
+
+    c7::result<msg_batch> wait(const tray_key& tray, c7::usec_t duration_us) {
+	return wait(tray, c7::mktimespec(duration_us));
+    }
+
+    // batch is cleared and its buffer is reused by the tray
+    c7::result<> wait(const tray_key& tray, msg_batch& batch,
+		      const ::timespec* timeout_abs = nullptr) {
+	return pimpl_->wait(tray, batch, timeout_abs);
     }
 
-    auto wait(const tray_key& tray, c7::usec_t duration_us) {
-	auto timeout_abs = c7::mktimespec(duration_us);
-	return pimpl_->wait(tray, timeout_abs);
+    c7::result<> wait(const tray_key& tray, msg_batch& batch, c7::usec_t duration_us) {
+	return pimpl_->wait(tray, batch, c7::mktimespec(duration_us));
     }
 
     c7::result<> close(tray_key tray_key) {
@@ -152,44 +177,78 @@ private:
     class impl: public std::enable_shared_from_this<impl> {
     private:
 	struct msg_tray {
-	    std::list<Msg> msgs;
+	    msg_batch msgs;
 	    uint64_t rc = 0;
+	    std::atomic<uint32_t> seq {0};	// futex word: changed by put/close
+	    uint32_t n_waiting = 0;
 	};
 
-	c7::thread::condvar cv_;
-	std::unordered_map<u64_key, std::shared_ptr<msg_tray>> box_;
+	struct alignas(64) shard {
+	    c7::thread::adaptive_mutex lock;
+	    std::unordered_map<u64_key, std::shared_ptr<msg_tray>> box;
+	};
+
+	static constexpr size_t n_shard = 16;	// power of 2
+	shard shards_[n_shard];
+
+	shard& shard_of(u64_key key) {
+	    return shards_[static_cast<uint64_t>(key) & (n_shard - 1)];
+	}
+
+	// call with shard lock, and wake after unlock
+	static std::shared_ptr<msg_tray> touch(std::shared_ptr<msg_tray>& tray) {
+	    tray->seq.fetch_add(1, std::memory_order_relaxed);
+	    return (tray->n_waiting != 0) ? tray : nullptr;
+	}
+
+	static void wake(const std::shared_ptr<msg_tray>& tray) {
+	    if (tray) {
+		futex_wake_all(tray->seq);
+	    }
+	}
 
     public:
 	tray_key reserve() {
 	    u64_key key{msgbox_impl::tray_id()};
-	    auto unlock = cv_.lock();
+	    auto& sh = shard_of(key);
 	    auto tray = std::make_shared<msg_tray>();
-	    box_.emplace(key, tray);
+	    auto unlock = sh.lock.lock();
+	    sh.box.emplace(key, std::move(tray));
 	    unlock();
 	    return tray_key(key, this->shared_from_this());
 	}
 
-	c7::result<std::list<Msg>> wait(const tray_key& key,
-					const ::timespec* timeout_abs = nullptr) {
-	    auto unlock = cv_.lock();
+	c7::result<> wait(const tray_key& key, msg_batch& batch,
+			  const ::timespec* timeout_abs = nullptr) {
+	    batch.clear();
+	    auto& sh = shard_of(key());
+	    auto unlock = sh.lock.lock();
 	    for (;;) {
-		auto it = box_.find(key());
-		if (it == box_.end()) {
+		auto it = sh.box.find(key());
+		if (it == sh.box.end()) {
 		    return c7result_err(ENOENT, "msg tray for key:%{} is not found", key());
 		}
-		auto& tray = (*it).second;
-		if (!tray->msgs.empty()) {
-		    return c7result_ok(std::move(tray->msgs));
+		if (auto& msgs = (*it).second->msgs; !msgs.empty()) {
+		    std::swap(msgs, batch);
+		    return c7result_ok();
 		}
-		if (!cv_.wait(timeout_abs)) {
+		auto tray = (*it).second;	// keep tray while unlocked
+		auto seq = tray->seq.load(std::memory_order_relaxed);
+		tray->n_waiting++;
+		unlock();
+		bool ok = futex_wait(tray->seq, seq, timeout_abs);
+		unlock = sh.lock.lock();
+		tray->n_waiting--;
+		if (!ok) {
 		    return c7result_err(EAGAIN, "timeout of waiting msg for key:%{}", key());
 		}
 	    }
 	}
 
 	c7::result<> ref(u64_key key) {
-	    auto unlock = cv_.lock();
-	    if (auto it = box_.find(key); it == box_.end()) {
+	    auto& sh = shard_of(key);
+	    auto unlock = sh.lock.lock();
+	    if (auto it = sh.box.find(key); it == sh.box.end()) {
 		return c7result_err(ENOENT, "msg tray for key:%{} is not found", key);
 	    } else {
 		auto& tray = (*it).second;
@@ -199,48 +258,60 @@ private:
 	}
 
 	c7::result<> unref(u64_key key) {
-	    auto unlock = cv_.lock();
-	    if (auto it = box_.find(key); it == box_.end()) {
+	    auto& sh = shard_of(key);
+	    auto unlock = sh.lock.lock();
+	    if (auto it = sh.box.find(key); it == sh.box.end()) {
 		return c7result_err(ENOENT, "msg tray for key:%{} is not found", key);
 	    } else {
 		auto& tray = (*it).second;
 		tray->rc--;
 		if (tray->rc == 0) {
-		    box_.erase(key);
-		    cv_.notify_all();
+		    auto waiting = touch(tray);
+		    sh.box.erase(it);
+		    unlock();
+		    wake(waiting);
 		}
 		return c7result_ok();
 	    }
 	}
 
 	c7::result<> close(u64_key key) {
-	    auto unlock = cv_.lock();
-	    if (box_.erase(key) == 0) {
+	    auto& sh = shard_of(key);
+	    auto unlock = sh.lock.lock();
+	    auto it = sh.box.find(key);
+	    if (it == sh.box.end()) {
 		return c7result_err(ENOENT, "msg tray for key:%{} is not found", key);
 	    }
-	    cv_.notify_all();
+	    auto waiting = touch((*it).second);
+	    sh.box.erase(it);
+	    unlock();
+	    wake(waiting);
 	    return c7result_ok();
 	}
 
 	template <typename M>
 	c7::result<> put_internal(u64_key key, M&& msg) {
-	    auto unlock = cv_.lock();
-	    auto it = box_.find(key);
-	    if (it == box_.end()) {
+	    auto& sh = shard_of(key);
+	    auto unlock = sh.lock.lock();
+	    auto it = sh.box.find(key);
+	    if (it == sh.box.end()) {
 		return c7result_err(ENOENT, "msg tray for key:%{} is not found", key);
 	    }
 	    auto& tray = (*it).second;
 	    tray->msgs.push_back(std::forward<M>(msg));
-	    cv_.notify_all();
+	    auto waiting = touch(tray);
+	    unlock();
+	    wake(waiting);
 	    return c7result_ok();
 	}
 
-	size_t size() const {
-	    return box_.size();
-	}
-
-	auto lock() {
-	    return cv_.lock();
+	size_t size() {
+	    size_t n = 0;
+	    for (auto& sh: shards_) {
+		auto unlock = sh.lock.lock();
+		n += sh.box.size();
+	    }
+	    return n;
 	}
     };
 
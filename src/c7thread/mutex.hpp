@@ -14,7 +14,7 @@
 #include <c7common.hpp>
 
 
-#include <c7defer.hpp>
+#include <c7thread/lock_guard.hpp>
 
 
 namespace c7::thread {
@@ -42,17 +42,13 @@ public:
     void unlock();
 
     [[nodiscard]]
-    c7::defer lock() {
-	_lock();
-	return c7::defer([this](){ unlock(); });
+    lock_guard<mutex> lock() {
+	return lock_guard<mutex>(*this);
     }
 
     [[nodiscard]]
-    c7::defer trylock() {
-	if (_trylock()) {
-	    return c7::defer([this](){ unlock(); });
-	}
-	return c7::defer();
+    lock_guard<mutex> trylock() {
+	return lock_guard<mutex>::adopt(_trylock() ? this : nullptr);
     }
 
     void lock_do(std::function<void()> critical) {
@@ -0,0 +1,453 @@
+/*
+ * c7thread/pool.cpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ */
+
+
+#include <c7defer.hpp>
+#include <c7format.hpp>
+#include <c7thread/pool.hpp>
+#include <c7thread/thread.hpp>
+#include <atomic>
+#include <deque>
+#include <unistd.h>
+#include "_private.hpp"
+
+
+namespace c7::thread {
+
+
+/*----------------------------------------------------------------------------
+                          Chase-Lev work-stealing deque
+----------------------------------------------------------------------------*/
+
+// N.M. Le, A. Pop, A. Cohen, F. Zappa Nardelli:
+//   "Correct and Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013)
+//
+// push() and pop() are called only by owner worker, steal() is called by any
+// thread. Arrays replaced by grow() are kept until the deque is destructed,
+// because a thief may still read them.
+
+class ws_deque {
+private:
+    using item_t = pool::task_t*;
+
+    struct array {
+	size_t mask;
+	std::unique_ptr<std::atomic<item_t>[]> buf;
+
+	explicit array(size_t cap): mask(cap - 1), buf(new std::atomic<item_t>[cap]) {}
+
+	size_t capacity() const {
+	    return mask + 1;
+	}
+
+	item_t get(int64_t i) const {
+	    return buf[i & mask].load(std::memory_order_relaxed);
+	}
+
+	void put(int64_t i, item_t x) {
+	    buf[i & mask].store(x, std::memory_order_relaxed);
+	}
+    };
+
+    alignas(64) std::atomic<int64_t> top_ {0};
+    alignas(64) std::atomic<int64_t> bottom_ {0};
+    std::atomic<array*> array_;
+    std::vector<std::unique_ptr<array>> arrays_;	// owner only
+
+    array *grow(array *a, int64_t t, int64_t b) {
+	auto n = std::make_unique<array>(a->capacity() * 2);
+	for (auto i = t; i < b; i++) {
+	    n->put(i, a->get(i));
+	}
+	auto p = n.get();
+	arrays_.push_back(std::move(n));
+	array_.store(p, std::memory_order_release);
+	return p;
+    }
+
+public:
+    static inline item_t const ABORT = reinterpret_cast<item_t>(1);
+
+    explicit ws_deque(size_t cap = 256) {
+	arrays_.push_back(std::make_unique<array>(cap));
+	array_.store(arrays_.back().get(), std::memory_order_relaxed);
+    }
+
+    ~ws_deque() {
+	auto a = array_.load(std::memory_order_relaxed);
+	auto b = bottom_.load(std::memory_order_relaxed);
+	for (auto t = top_.load(std::memory_order_relaxed); t < b; t++) {
+	    delete a->get(t);
+	}
+    }
+
+    int64_t size() const {
+	auto b = bottom_.load(std::memory_order_relaxed);
+	auto t = top_.load(std::memory_order_relaxed);
+	return b - t;
+    }
+
+    void push(item_t x) {
+	auto b = bottom_.load(std::memory_order_relaxed);
+	auto t = top_.load(std::memory_order_acquire);
+	auto a = array_.load(std::memory_order_relaxed);
+	if (b - t > static_cast<int64_t>(a->capacity()) - 1) {
+	    a = grow(a, t, b);
+	}
+	a->put(b, x);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    item_t pop() {
+	auto b = bottom_.load(std::memory_order_relaxed) - 1;
+	auto a = array_.load(std::memory_order_relaxed);
+	bottom_.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	auto t = top_.load(std::memory_order_relaxed);
+	item_t x = nullptr;
+	if (t <= b) {
+	    x = a->get(b);
+	    if (t == b) {
+		// last item: race with thieves
+		if (!top_.compare_exchange_strong(t, t + 1,
+						  std::memory_order_seq_cst,
+						  std::memory_order_relaxed)) {
+		    x = nullptr;
+		}
+		bottom_.store(b + 1, std::memory_order_relaxed);
+	    }
+	} else {
+	    bottom_.store(b + 1, std::memory_order_relaxed);
+	}
+	return x;
+    }
+
+    // nullptr: empty, ABORT: lost race (retry)
+    item_t steal() {
+	auto t = top_.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	auto b = bottom_.load(std::memory_order_acquire);
+	if (t < b) {
+	    auto a = array_.load(std::memory_order_acquire);
+	    auto x = a->get(t);
+	    if (!top_.compare_exchange_strong(t, t + 1,
+					      std::memory_order_seq_cst,
+					      std::memory_order_relaxed)) {
+		return ABORT;
+	    }
+	    return x;
+	}
+	return nullptr;
+    }
+};
+
+
+/*----------------------------------------------------------------------------
+                                  pool::impl
+----------------------------------------------------------------------------*/
+
+class pool::impl {
+private:
+    struct worker {
+	ws_deque deque;
+	c7::thread::thread th;
+	std::atomic<uint64_t> n_task {0};
+	std::atomic<uint64_t> n_steal {0};
+	std::atomic<uint64_t> n_global {0};
+	std::atomic<uint64_t> n_sleep {0};
+    };
+
+    struct current_t {
+	impl *owner = nullptr;
+	size_t index = 0;
+    };
+
+    static thread_local current_t current_;
+
+    pool& owner_;
+    pool_config config_;
+    std::vector<std::unique_ptr<worker>> workers_;
+
+    c7::thread::mutex gq_lock_;
+    std::deque<task_t*> gq_;
+    std::atomic<size_t> gq_n_ {0};
+
+    c7::thread::condvar cv_;
+    std::atomic<int> n_sleeping_ {0};
+    std::atomic<size_t> n_pending_ {0};		// posted but not finished
+    std::atomic<bool> stop_ {false};
+    std::atomic<uint64_t> n_task_ext_ {0};	// executed by non-worker thread
+
+    bool has_work() const {
+	if (gq_n_.load(std::memory_order_relaxed) != 0) {
+	    return true;
+	}
+	for (auto& w: workers_) {
+	    if (w->deque.size() > 0) {
+		return true;
+	    }
+	}
+	return false;
+    }
+
+    bool finished() const {
+	return stop_.load() && n_pending_.load() == 0;
+    }
+
+    task_t *take_global() {
+	if (gq_n_.load(std::memory_order_relaxed) == 0) {
+	    return nullptr;
+	}
+	auto unlock = gq_lock_.lock();
+	if (gq_.empty()) {
+	    return nullptr;
+	}
+	auto t = gq_.front();
+	gq_.pop_front();
+	gq_n_.fetch_sub(1, std::memory_order_relaxed);
+	return t;
+    }
+
+    task_t *steal(size_t self) {
+	auto n = workers_.size();
+	for (size_t k = 1; k <= n; k++) {
+	    auto& dq = workers_[(self + k) % n]->deque;
+	    for (;;) {
+		auto t = dq.steal();
+		if (t != ws_deque::ABORT) {
+		    if (t != nullptr) {
+			return t;
+		    }
+		    break;
+		}
+	    }
+	}
+	return nullptr;
+    }
+
+    void execute(task_t *t) {
+	c7::defer done([this, t]() {
+		delete t;
+		if (n_pending_.fetch_sub(1) == 1 && stop_.load()) {
+		    auto unlock = cv_.lock();
+		    cv_.notify_all();
+		}
+	    });
+	try {
+	    (*t)();
+	} catch (std::exception& e) {
+	    c7::p_("c7::thread::pool: task is terminated by exception: %{}", e.what());
+	} catch (...) {
+	    c7::p_("c7::thread::pool: task is terminated by unknown exception");
+	}
+    }
+
+    void setup_worker(size_t index) {
+	auto name = c7::format("%{}:%{}", config_.name, index);
+	(void)pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+	if (!config_.cpus.empty()) {
+	    cpu_set_t set;
+	    CPU_ZERO(&set);
+	    CPU_SET(config_.cpus[index % config_.cpus.size()], &set);
+	    (void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+	current_.owner = this;
+	current_.index = index;
+    }
+
+    void worker_loop(size_t index) {
+	setup_worker(index);
+	auto& w = *workers_[index];
+	for (;;) {
+	    if (run_one()) {
+		continue;
+	    }
+	    if (finished()) {
+		break;
+	    }
+	    n_sleeping_.fetch_add(1);			// seq_cst: pairs with post()
+	    {
+		auto unlock = cv_.lock();
+		if (!has_work() && !finished()) {
+		    w.n_sleep.fetch_add(1, std::memory_order_relaxed);
+		    cv_.wait();
+		}
+	    }
+	    n_sleeping_.fetch_sub(1);
+	}
+	current_.owner = nullptr;
+    }
+
+public:
+    impl(pool& owner, const pool_config& config): owner_(owner), config_(config) {
+	auto n = config_.n_worker;
+	if (n == 0) {
+	    auto ncpu = ::sysconf(_SC_NPROCESSORS_ONLN);
+	    n = (ncpu > 0) ? static_cast<size_t>(ncpu) : 1;
+	}
+	for (size_t i = 0; i < n; i++) {
+	    workers_.push_back(std::make_unique<worker>());
+	}
+	for (size_t i = 0; i < n; i++) {
+	    auto& th = workers_[i]->th;
+	    th.set_name(c7::format("%{}:%{}", config_.name, i));
+	    th.target([this, i](){ worker_loop(i); });
+	    if (auto res = th.start(); !res) {
+		shutdown();
+		throw thread_error(EAGAIN, "c7::thread::pool: cannot start worker");
+	    }
+	}
+    }
+
+    ~impl() {
+	shutdown();
+	for (auto t: gq_) {
+	    delete t;
+	}
+    }
+
+    void shutdown() {
+	stop_ = true;
+	{
+	    auto unlock = cv_.lock();
+	    cv_.notify_all();
+	}
+	for (auto& w: workers_) {
+	    (void)w->th.join();			// false if not started
+	}
+    }
+
+    static pool *current() {
+	auto p = current_.owner;
+	return p ? &p->owner_ : nullptr;
+    }
+
+    size_t size() const {
+	return workers_.size();
+    }
+
+    void post(task_t&& task) {
+	auto t = new task_t(std::move(task));
+	n_pending_.fetch_add(1);
+	if (current_.owner == this) {
+	    workers_[current_.index]->deque.push(t);
+	} else {
+	    auto unlock = gq_lock_.lock();
+	    gq_.push_back(t);
+	    gq_n_.fetch_add(1, std::memory_order_relaxed);
+	}
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (n_sleeping_.load() > 0) {
+	    auto unlock = cv_.lock();
+	    cv_.notify();
+	}
+    }
+
+    bool run_one() {
+	task_t *t = nullptr;
+	if (current_.owner == this) {
+	    auto& w = *workers_[current_.index];
+	    if ((t = w.deque.pop()) == nullptr) {
+		if ((t = take_global()) != nullptr) {
+		    w.n_global.fetch_add(1, std::memory_order_relaxed);
+		} else if ((t = steal(current_.index)) != nullptr) {
+		    w.n_steal.fetch_add(1, std::memory_order_relaxed);
+		} else {
+		    return false;
+		}
+	    }
+	    w.n_task.fetch_add(1, std::memory_order_relaxed);
+	} else {
+	    if ((t = take_global()) == nullptr && (t = steal(0)) == nullptr) {
+		return false;
+	    }
+	    n_task_ext_.fetch_add(1, std::memory_order_relaxed);
+	}
+	execute(t);
+	return true;
+    }
+
+    stats_t stats() const {
+	stats_t st;
+	st.n_task = n_task_ext_.load(std::memory_order_relaxed);
+	for (auto& w: workers_) {
+	    st.n_task   += w->n_task.load(std::memory_order_relaxed);
+	    st.n_steal  += w->n_steal.load(std::memory_order_relaxed);
+	    st.n_global += w->n_global.load(std::memory_order_relaxed);
+	    st.n_sleep  += w->n_sleep.load(std::memory_order_relaxed);
+	}
+	return st;
+    }
+};
+
+
+thread_local pool::impl::current_t pool::impl::current_;
+
+
+/*----------------------------------------------------------------------------
+                                     pool
+----------------------------------------------------------------------------*/
+
+pool::pool(const pool_config& config):
+    pimpl_(std::make_unique<impl>(*this, config))
+{
+}
+
+
+pool::~pool()
+{
+}
+
+
+size_t pool::size() const
+{
+    return pimpl_->size();
+}
+
+
+void pool::post(task_t&& task)
+{
+    pimpl_->post(std::move(task));
+}
+
+
+bool pool::run_one()
+{
+    return pimpl_->run_one();
+}
+
+
+pool *pool::current()
+{
+    return impl::current();
+}
+
+
+pool::stats_t pool::stats() const
+{
+    return pimpl_->stats();
+}
+
+
+void pool::stats_t::print(std::ostream& out, const std::string&) const
+{
+    c7::format(out, "task:%{} steal:%{} global:%{} sleep:%{}",
+	       n_task, n_steal, n_global, n_sleep);
+}
+
+
+pool& default_pool()
+{
+    static pool pool_{pool_config{0, "c7pool", {}}};
+    return pool_;
+}
+
+
+} // namespace c7::thread
@@ -0,0 +1,270 @@
+/*
+ * c7thread/pool.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google spreadsheets:
+ * (Nothing)
+ */
+#ifndef C7_THREAD_POOL_HPP_LOADED_
+#define C7_THREAD_POOL_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7result.hpp>
+#include <c7thread/condvar.hpp>
+#include <c7utils/time.hpp>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+namespace c7::thread {
+
+
+// work-stealing thread pool
+// -------------------------
+//
+// - Each worker has Chase-Lev deque. A task submitted on worker thread is pushed
+//   to its own deque (LIFO for owner), and idle workers steal from other deques
+//   (FIFO). A task submitted on other threads is put into global queue.
+// - Worker threads are named "<name>:<index>", and optionally pinned to CPUs.
+// - submit() returns task_future<T> whose result is c7::result<T>. If a task
+//   function returns c7::result<T>, it's stored as it is. Exception thrown by
+//   task function is converted to error result.
+// - Destructor waits for completion of all submitted tasks.
+// - default_pool() is process-wide pool which can be shared by subsystems.
+//
+//   [Example]
+//
+//      auto f = c7::thread::default_pool().submit([]() { return 10; });
+//      auto g = f.then([](c7::result<int>&& r) { return r.value() * 2; });
+//      int v = g.get().value();			// 20
+
+struct pool_config {
+    size_t n_worker = 0;		// 0: number of online CPUs
+    std::string name = "pool";		// prefix of worker thread name
+    std::vector<int> cpus;		// worker i is pinned to cpus[i % size] (empty: not pinned)
+};
+
+
+class pool;
+
+template <typename T> class task_future;
+
+
+// c7::result<T> -> T, others are as they are
+template <typename R>
+struct task_value {
+    using type = R;
+};
+
+template <typename T, typename Tag>
+struct task_value<c7::result<T, Tag>> {
+    using type = T;
+};
+
+template <typename R>
+using task_value_t = typename task_value<R>::type;
+
+
+class pool {
+public:
+    using task_t = std::function<void()>;
+
+    struct stats_t {
+	uint64_t n_task = 0;		// executed tasks
+	uint64_t n_steal = 0;		// tasks stolen from other workers
+	uint64_t n_global = 0;		// tasks taken from global queue
+	uint64_t n_sleep = 0;		// workers went to sleep
+
+	void print(std::ostream& out, const std::string&) const;
+    };
+
+    pool(const pool&) = delete;
+    pool& operator=(const pool&) = delete;
+    pool(pool&&) = delete;
+    pool& operator=(pool&&) = delete;
+
+    explicit pool(const pool_config& config = pool_config{});
+    ~pool();
+
+    size_t size() const;
+
+    // run task without result
+    void post(task_t&& task);
+
+    // run task and get result through task_future
+    template <typename F>
+    auto submit(F&& func) -> task_future<task_value_t<std::invoke_result_t<F>>>;
+
+    // run one queued task on caller thread if exists (used while waiting future)
+    bool run_one();
+
+    // pool of which caller is worker thread, or nullptr
+    static pool *current();
+
+    stats_t stats() const;
+
+private:
+    class impl;
+    std::unique_ptr<impl> pimpl_;
+};
+
+
+pool& default_pool();
+
+
+/*----------------------------------------------------------------------------
+                                 task_future
+----------------------------------------------------------------------------*/
+
+template <typename T>
+class task_future {
+private:
+    friend class pool;
+    template <typename> friend class task_future;
+
+    struct state {
+	c7::thread::condvar cv;
+	bool done = false;
+	std::optional<c7::result<T>> res;
+	std::vector<std::function<void()>> continuations;
+	c7::thread::pool *pool;
+
+	explicit state(c7::thread::pool *p): pool(p) {}
+
+	void complete(c7::result<T>&& r) {
+	    std::vector<std::function<void()>> conts;
+	    {
+		auto unlock = cv.lock();
+		res.emplace(std::move(r));
+		done = true;
+		conts.swap(continuations);
+		cv.notify_all();
+	    }
+	    for (auto& c: conts) {
+		pool->post(std::move(c));
+	    }
+	}
+    };
+
+    std::shared_ptr<state> state_;
+
+    explicit task_future(std::shared_ptr<state> st): state_(std::move(st)) {}
+
+public:
+    task_future() = default;
+
+    bool valid() const {
+	return (state_ != nullptr);
+    }
+
+    bool ready() const {
+	auto unlock = state_->cv.lock();
+	return state_->done;
+    }
+
+    // If caller is worker thread of the pool, other tasks are executed while waiting.
+    void wait() const {
+	if (pool::current() == state_->pool) {
+	    while (!ready()) {
+		if (!state_->pool->run_one()) {
+		    auto unlock = state_->cv.lock();
+		    state_->cv.wait_for(c7::mktimespec(1000), [this](){ return state_->done; });
+		}
+	    }
+	} else {
+	    auto unlock = state_->cv.lock();
+	    state_->cv.wait_for([this](){ return state_->done; });
+	}
+    }
+
+    // wait and take result (result can be taken only once)
+    c7::result<T> get() {
+	wait();
+	auto unlock = state_->cv.lock();
+	return std::move(*state_->res);
+    }
+
+    // func(c7::result<T>&&) is submitted to pool after this task is completed,
+    // and takes the result of this task.
+    template <typename F>
+    auto then(F&& func) -> task_future<task_value_t<std::invoke_result_t<F, c7::result<T>&&>>>;
+};
+
+
+/*----------------------------------------------------------------------------
+                             pool implementation
+----------------------------------------------------------------------------*/
+
+template <typename T, typename F, typename... Args>
+c7::result<T> invoke_task(F& func, Args&&... args)
+{
+    using R = std::invoke_result_t<F, Args...>;
+    try {
+	if constexpr (std::is_void_v<R>) {
+	    func(std::forward<Args>(args)...);
+	    return c7result_ok();
+	} else if constexpr (std::is_same_v<R, c7::result<T>>) {
+	    return func(std::forward<Args>(args)...);
+	} else {
+	    return c7result_ok(func(std::forward<Args>(args)...));
+	}
+    } catch (c7::result_exception& e) {
+	return std::move(e.as_result());
+    } catch (std::exception& e) {
+	return c7result_err(EFAULT, "task: exception: %{}", e.what());
+    } catch (...) {
+	return c7result_err(EFAULT, "task: unknown exception");
+    }
+}
+
+
+template <typename F>
+auto pool::submit(F&& func) -> task_future<task_value_t<std::invoke_result_t<F>>>
+{
+    using T = task_value_t<std::invoke_result_t<F>>;
+    using future_type = task_future<T>;
+    auto st = std::make_shared<typename future_type::state>(this);
+    post([st, f = std::forward<F>(func)]() mutable {
+	    st->complete(invoke_task<T>(f));
+	});
+    return future_type(st);
+}
+
+
+template <typename T>
+template <typename F>
+auto task_future<T>::then(F&& func) -> task_future<task_value_t<std::invoke_result_t<F, c7::result<T>&&>>>
+{
+    using U = task_value_t<std::invoke_result_t<F, c7::result<T>&&>>;
+    using future_type = task_future<U>;
+    auto src = state_;
+    auto dst = std::make_shared<typename future_type::state>(src->pool);
+    auto cont = [src, dst, f = std::forward<F>(func)]() mutable {
+	auto r = std::move(*src->res);
+	dst->complete(invoke_task<U>(f, std::move(r)));
+    };
+
+    auto unlock = src->cv.lock();
+    if (src->done) {
+	unlock();
+	src->pool->post(std::move(cont));
+    } else {
+	src->continuations.push_back(std::move(cont));
+    }
+    return future_type(dst);
+}
+
+
+} // namespace c7::thread
+
+
+#endif // c7thread/pool.hpp
@@ -15,6 +15,7 @@
 
 
 #include <c7thread/_queue.hpp>
+#include <c7utils/chunk_ring.hpp>
 
 
 namespace c7::thread {
@@ -22,7 +23,7 @@ namespace c7::thread {
 
 template <typename T,
 	  template <typename, typename = std::allocator<T>>
-	  class Container = std::list>
+	  class Container = c7::chunk_ring>
 class queue: public queue_base<T, queue<T, Container>> {
 private:
     using base_type = queue_base<T, queue<T, Container>>;
@@ -79,12 +80,28 @@ public:
 	[[maybe_unused]] size_t weight;
 	return base_type::get(weight, tmo_us);
     }
+
+    // move all items of range (wait if limit is reached), return number of put items.
+    template <typename Range>
+    c7::result<size_t> put_n(Range&& items, c7::usec_t tmo_us = -1) {
+	return base_type::put_n(std::begin(items), std::end(items),
+				[](auto&) { return 1; },
+				[](auto& item) -> T&& { return std::move(item); },
+				tmo_us);
+    }
+
+    // get 1 .. max_n items (wait only if empty), return number of got items.
+    template <typename OutputIt>
+    c7::result<size_t> get_n(OutputIt out, size_t max_n, c7::usec_t tmo_us = -1) {
+	return base_type::get_n([&out](T&& item, size_t) { *out++ = std::move(item); },
+				max_n, tmo_us);
+    }
 };
 
 
 template <typename T,
 	  template <typename, typename = std::allocator<T>>
-	  class Container = std::list>
+	  class Container = c7::chunk_ring>
 class sync_queue: public queue<T, Container> {
 private:
     using base_type = queue<T, Container>;
@@ -0,0 +1,280 @@
+/*
+ * c7thread/ring_queue.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google spreadsheets:
+ * (Nothing)
+ */
+#ifndef C7_THREAD_RING_QUEUE_HPP_LOADED_
+#define C7_THREAD_RING_QUEUE_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7result.hpp>
+#include <c7utils/time.hpp>
+#include <c7thread/futex.hpp>
+#include <atomic>
+#include <new>
+#include <sched.h>
+
+
+namespace c7::thread {
+
+
+// bounded lock-free MPMC ring queue
+// ---------------------------------
+//
+// - D.Vyukov's bounded MPMC queue: each cell has a sequence number, and
+//   producers/consumers claim a position by CAS on their own index. No
+//   allocation and no lock on put/get.
+// - put() blocks on futex only when the ring is full, and get() only when it's
+//   empty (after yielding a few times). A waker calls futex only if there is a
+//   waiter.
+// - close(), abort(), reset(), put(item, tmo) and get(tmo) have same semantics
+//   and error codes as c7::thread::queue:
+//	put: ETIMEDOUT, EPIPE (not alive)
+//	get: ETIMEDOUT, ENODATA (closing and empty, or closed), EPIPE (aborted)
+// - N must be power of 2.
+
+template <typename T, size_t N>
+class ring_queue {
+public:
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be power of 2");
+
+    ring_queue(const ring_queue&) = delete;
+    ring_queue& operator=(const ring_queue&) = delete;
+
+    ring_queue() {
+	for (size_t i = 0; i < N; i++) {
+	    cells_[i].seq.store(i, std::memory_order_relaxed);
+	}
+    }
+
+    ~ring_queue() {
+	clear_queue();
+    }
+
+    static constexpr size_t capacity() {
+	return N;
+    }
+
+    // approximate
+    size_t size() const {
+	auto e = enq_pos_.load(std::memory_order_relaxed);
+	auto d = deq_pos_.load(std::memory_order_relaxed);
+	return (e > d) ? (e - d) : 0;
+    }
+
+    // non-blocking (status is not checked)
+    bool try_put(T&& item) {
+	auto pos = enq_pos_.load(std::memory_order_relaxed);
+	cell *c;
+	for (;;) {
+	    c = &cells_[pos & mask];
+	    auto seq = c->seq.load(std::memory_order_acquire);
+	    auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+	    if (dif == 0) {
+		if (enq_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+		    break;
+		}
+	    } else if (dif < 0) {
+		return false;		// full
+	    } else {
+		pos = enq_pos_.load(std::memory_order_relaxed);
+	    }
+	}
+	new (c->data) T(std::move(item));
+	c->seq.store(pos + 1, std::memory_order_release);
+	wake(not_empty_, n_get_waiting_);
+	return true;
+    }
+
+    // non-blocking (status is not checked)
+    bool try_get(T& item) {
+	auto pos = deq_pos_.load(std::memory_order_relaxed);
+	cell *c;
+	for (;;) {
+	    c = &cells_[pos & mask];
+	    auto seq = c->seq.load(std::memory_order_acquire);
+	    auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+	    if (dif == 0) {
+		if (deq_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+		    break;
+		}
+	    } else if (dif < 0) {
+		return false;		// empty
+	    } else {
+		pos = deq_pos_.load(std::memory_order_relaxed);
+	    }
+	}
+	auto p = std::launder(reinterpret_cast<T*>(c->data));
+	item = std::move(*p);
+	p->~T();
+	c->seq.store(pos + mask + 1, std::memory_order_release);
+	wake(not_full_, n_put_waiting_);
+	return true;
+    }
+
+    c7::result<> put(T&& item, c7::usec_t tmo_us = -1) {
+	::timespec abstime, *abstime_p = nullptr;
+	for (;;) {
+	    if (!is_alive()) {
+		return c7result_err(EPIPE, "queue is not alived (closing/closed/aborted)");
+	    }
+	    if (try_put(std::move(item))) {
+		return c7result_ok();
+	    }
+	    if (abstime_p == nullptr && tmo_us >= 0) {
+		abstime = *c7::mktimespec(tmo_us);
+		abstime_p = &abstime;
+	    }
+	    if (!sleep(not_full_, n_put_waiting_, abstime_p,
+		       [this](){ return !is_alive() || can_put(); })) {
+		return c7result_err(ETIMEDOUT);
+	    }
+	}
+    }
+
+    c7::result<T> get(c7::usec_t tmo_us = -1) {
+	::timespec abstime, *abstime_p = nullptr;
+	T item;
+	for (;;) {
+	    if (is_aborted()) {
+		return c7result_err(EPIPE, "queue is aborted");
+	    }
+	    if (try_get(item)) {
+		return c7result_ok(std::move(item));
+	    }
+	    if (is_closed()) {
+		return c7result_err(ENODATA, "queue is closed");
+	    }
+	    if (is_closing()) {
+		return c7result_err(ENODATA, "queue is closing");
+	    }
+	    if (abstime_p == nullptr && tmo_us >= 0) {
+		abstime = *c7::mktimespec(tmo_us);
+		abstime_p = &abstime;
+	    }
+	    if (!sleep(not_empty_, n_get_waiting_, abstime_p,
+		       [this](){ return !is_alive() || can_get(); })) {
+		return c7result_err(ETIMEDOUT);
+	    }
+	}
+    }
+
+    void close() {
+	status_ = (size() == 0) ? CLOSED : CLOSING;
+	wake_all();
+    }
+
+    void abort() {
+	status_ = ABORTED;
+	clear_queue();
+	wake_all();
+    }
+
+    void reset() {
+	clear_queue();
+	status_ = ALIVE;
+    }
+
+    bool is_aborted() const {
+	return (status_ == ABORTED);
+    }
+
+    bool is_closed() const {
+	return (status_ == CLOSED);
+    }
+
+    bool is_closing() const {
+	return (status_ == CLOSING);
+    }
+
+    bool is_alive() const {
+	return (status_ == ALIVE);
+    }
+
+private:
+    enum run_status { ALIVE, CLOSING, CLOSED, ABORTED };
+    static constexpr size_t mask = N - 1;
+    static constexpr int spin_count = 16;	// sched_yield() before futex wait
+
+    struct alignas(64) cell {
+	std::atomic<size_t> seq;
+	alignas(T) unsigned char data[sizeof(T)];
+    };
+
+    alignas(64) std::atomic<size_t> enq_pos_ {0};
+    alignas(64) std::atomic<size_t> deq_pos_ {0};
+    alignas(64) std::atomic<uint32_t> not_empty_ {0};	// futex word for get
+    std::atomic<uint32_t> n_get_waiting_ {0};
+    alignas(64) std::atomic<uint32_t> not_full_ {0};	// futex word for put
+    std::atomic<uint32_t> n_put_waiting_ {0};
+    alignas(64) std::atomic<run_status> status_ {ALIVE};
+    cell cells_[N];
+
+    static void wake(std::atomic<uint32_t>& word, std::atomic<uint32_t>& n_waiting) {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (n_waiting.load(std::memory_order_relaxed) != 0) {
+	    word.fetch_add(1, std::memory_order_release);
+	    futex_wake(word);
+	}
+    }
+
+    // cell at enq_pos_ is released by consumer (or enq_pos_ is already moved)
+    bool can_put() const {
+	auto pos = enq_pos_.load(std::memory_order_relaxed);
+	auto seq = cells_[pos & mask].seq.load(std::memory_order_acquire);
+	return static_cast<intptr_t>(seq - pos) >= 0;
+    }
+
+    // cell at deq_pos_ is filled by producer (or deq_pos_ is already moved)
+    bool can_get() const {
+	auto pos = deq_pos_.load(std::memory_order_relaxed);
+	auto seq = cells_[pos & mask].seq.load(std::memory_order_acquire);
+	return static_cast<intptr_t>(seq - (pos + 1)) >= 0;
+    }
+
+    void wake_all() {
+	not_empty_.fetch_add(1);
+	not_full_.fetch_add(1);
+	futex_wake_all(not_empty_);
+	futex_wake_all(not_full_);
+    }
+
+    // Yield a few times, then register as waiter, recheck by ready(), and sleep
+    // if not ready.
+    // Return false on timeout.
+    template <typename Ready>
+    bool sleep(std::atomic<uint32_t>& word, std::atomic<uint32_t>& n_waiting,
+	       const ::timespec *abstime_p, Ready ready) {
+	for (int i = 0; i < spin_count; i++) {
+	    if (ready()) {
+		return true;
+	    }
+	    sched_yield();
+	}
+	auto val = word.load(std::memory_order_acquire);
+	n_waiting.fetch_add(1);			// seq_cst: pairs with fence in wake()
+	bool ok = ready() || futex_wait(word, val, abstime_p);
+	n_waiting.fetch_sub(1);
+	return ok;
+    }
+
+    void clear_queue() {
+	T item;
+	while (try_get(item)) {
+	    item = T();
+	}
+    }
+};
+
+
+} // namespace c7::thread
+
+
+#endif // c7thread/ring_queue.hpp
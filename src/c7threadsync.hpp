@@ -14,6 +14,7 @@
 #include <c7common.hpp>
 
 
+#include <c7thread/barrier.hpp>
 #include <c7thread/group.hpp>
 #include <c7thread/counter.hpp>
 #include <c7thread/event.hpp>
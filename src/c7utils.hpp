@@ -15,7 +15,9 @@
 
 
 #include <c7utils/c_array.hpp>
+#include <c7utils/chunk_ring.hpp>
 #include <c7utils/endian.hpp>
+#include <c7utils/histogram.hpp>
 #include <c7utils/loop_assist.hpp>
 #include <c7utils/memory.hpp>
 #include <c7utils/movable_capture.hpp>
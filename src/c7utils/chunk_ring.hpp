@@ -0,0 +1,229 @@
+/*
+ * c7utils/chunk_ring.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google spreadsheets:
+ * (Nothing)
+ */
+#ifndef C7_UTILS_CHUNK_RING_HPP_LOADED_
+#define C7_UTILS_CHUNK_RING_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <iterator>
+#include <memory>
+#include <new>
+
+
+namespace c7 {
+
+
+// FIFO container of fixed size chunks
+// -----------------------------------
+//
+// - Items are stored in a linked list of chunks. A chunk emptied by pop_front()
+//   is kept in a free list and reused by emplace_back(), so that steady state
+//   operation doesn't allocate. (chunks are released only by destructor)
+// - Subset of std::list interface used as Container of c7::thread::queue etc.:
+//   emplace_back, front, pop_front, size, empty, clear, begin, end.
+
+template <typename T, typename Alloc = std::allocator<T>>
+class chunk_ring {
+private:
+    static constexpr size_t chunk_n = (sizeof(T) >= 256) ? 4 : (1024 / sizeof(T));
+
+    struct chunk {
+	chunk *next;
+	alignas(T) unsigned char data[chunk_n * sizeof(T)];
+
+	T *at(size_t i) {
+	    return std::launder(reinterpret_cast<T*>(data) + i);
+	}
+    };
+
+    using chunk_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<chunk>;
+    using chunk_traits = std::allocator_traits<chunk_alloc_t>;
+
+    chunk_alloc_t alloc_;
+    chunk *head_ = nullptr;
+    chunk *tail_ = nullptr;
+    chunk *free_ = nullptr;
+    size_t head_idx_ = 0;		// index of front item in head_
+    size_t tail_idx_ = 0;		// index of next item in tail_
+    size_t size_ = 0;
+
+    chunk *new_chunk() {
+	chunk *c = free_;
+	if (c != nullptr) {
+	    free_ = c->next;
+	} else {
+	    c = chunk_traits::allocate(alloc_, 1);
+	}
+	c->next = nullptr;
+	return c;
+    }
+
+    void free_chunks(chunk *c) {
+	while (c != nullptr) {
+	    auto next = c->next;
+	    chunk_traits::deallocate(alloc_, c, 1);
+	    c = next;
+	}
+    }
+
+    template <typename U>
+    class iterator_base {
+    private:
+	friend class chunk_ring;
+	chunk *c_;
+	size_t i_;
+
+	iterator_base(chunk *c, size_t i): c_(c), i_(i) {}
+
+    public:
+	using difference_type	= ptrdiff_t;
+	using value_type	= std::remove_const_t<U>;
+	using pointer		= U*;
+	using reference		= U&;
+	using iterator_category	= std::forward_iterator_tag;
+
+	iterator_base(): c_(nullptr), i_(0) {}
+
+	U& operator*() const {
+	    return *c_->at(i_);
+	}
+
+	U* operator->() const {
+	    return c_->at(i_);
+	}
+
+	iterator_base& operator++() {
+	    if (++i_ == chunk_n) {
+		c_ = c_->next;
+		i_ = 0;
+	    }
+	    return *this;
+	}
+
+	iterator_base operator++(int) {
+	    auto it = *this;
+	    ++(*this);
+	    return it;
+	}
+
+	bool operator==(const iterator_base& o) const {
+	    return c_ == o.c_ && i_ == o.i_;
+	}
+
+	bool operator!=(const iterator_base& o) const {
+	    return !(*this == o);
+	}
+    };
+
+public:
+    using value_type = T;
+    using allocator_type = Alloc;
+    using iterator = iterator_base<T>;
+    using const_iterator = iterator_base<const T>;
+
+    chunk_ring(const chunk_ring&) = delete;
+    chunk_ring& operator=(const chunk_ring&) = delete;
+
+    chunk_ring() = default;
+
+    explicit chunk_ring(const Alloc& alloc): alloc_(alloc) {}
+
+    ~chunk_ring() {
+	clear();
+	free_chunks(head_);
+	free_chunks(free_);
+    }
+
+    size_t size() const {
+	return size_;
+    }
+
+    bool empty() const {
+	return size_ == 0;
+    }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+	if (tail_ == nullptr) {
+	    head_ = tail_ = new_chunk();
+	    head_idx_ = tail_idx_ = 0;
+	} else if (tail_idx_ == chunk_n) {
+	    tail_->next = new_chunk();
+	    tail_ = tail_->next;
+	    tail_idx_ = 0;
+	}
+	auto p = new (tail_->at(tail_idx_)) T(std::forward<Args>(args)...);
+	tail_idx_++;
+	size_++;
+	return *p;
+    }
+
+    void push_back(T&& item) {
+	(void)emplace_back(std::move(item));
+    }
+
+    void push_back(const T& item) {
+	(void)emplace_back(item);
+    }
+
+    T& front() {
+	return *head_->at(head_idx_);
+    }
+
+    const T& front() const {
+	return *head_->at(head_idx_);
+    }
+
+    void pop_front() {
+	head_->at(head_idx_)->~T();
+	head_idx_++;
+	size_--;
+	if (size_ == 0) {
+	    // head_ == tail_: reuse it from the top
+	    head_idx_ = tail_idx_ = 0;
+	} else if (head_idx_ == chunk_n) {
+	    auto next = head_->next;
+	    head_->next = free_;
+	    free_ = head_;
+	    head_ = next;
+	    head_idx_ = 0;
+	}
+    }
+
+    void clear() {
+	while (size_ != 0) {
+	    pop_front();
+	}
+    }
+
+    iterator begin() {
+	return iterator(head_, head_idx_);
+    }
+
+    iterator end() {
+	return (tail_idx_ == chunk_n) ? iterator(nullptr, 0) : iterator(tail_, tail_idx_);
+    }
+
+    const_iterator begin() const {
+	return const_iterator(head_, head_idx_);
+    }
+
+    const_iterator end() const {
+	return (tail_idx_ == chunk_n) ? const_iterator(nullptr, 0) : const_iterator(tail_, tail_idx_);
+    }
+};
+
+
+} // namespace c7
+
+
+#endif // c7utils/chunk_ring.hpp
@@ -0,0 +1,112 @@
+/*
+ * c7utils/histogram.hpp
+ *
+ * Copyright (c) 2021 ccldaout@gmail.com
+ *
+ * This software is released under the MIT License.
+ * http://opensource.org/licenses/mit-license.php
+ *
+ * Google spreadsheets:
+ * (Nothing)
+ */
+#ifndef C7_UTILS_HISTOGRAM_HPP_LOADED_
+#define C7_UTILS_HISTOGRAM_HPP_LOADED_
+#include <c7common.hpp>
+
+
+#include <c7format.hpp>
+#include <algorithm>
+
+
+namespace c7 {
+
+
+// histogram of power of 2 buckets
+// -------------------------------
+//
+// - Each range [2^e, 2^(e+1)) is divided into n_sub linear sub-buckets (as HDR
+//   histogram), and values less than n_sub have their own bucket. So an upper
+//   bound reported by percentile() exceeds the true value by at most 1/n_sub.
+// - add() is cheap enough (no division, no allocation) to be called in event loop.
+
+class log2_histogram {
+public:
+    static constexpr int sub_bits = 3;
+    static constexpr int n_sub = 1 << sub_bits;
+    static constexpr int n_bucket = (64 - sub_bits + 1) * n_sub;
+
+    void add(uint64_t v) {
+	buckets_[bucket_of(v)]++;
+	n_++;
+	sum_ += v;
+	max_ = std::max(max_, v);
+    }
+
+    void merge(const log2_histogram& o) {
+	for (int i = 0; i < n_bucket; i++) {
+	    buckets_[i] += o.buckets_[i];
+	}
+	n_ += o.n_;
+	sum_ += o.sum_;
+	max_ = std::max(max_, o.max_);
+    }
+
+    void clear() {
+	*this = log2_histogram();
+    }
+
+    uint64_t count() const { return n_; }
+    uint64_t sum() const { return sum_; }
+    uint64_t max() const { return max_; }
+    uint64_t mean() const { return (n_ == 0) ? 0 : sum_ / n_; }
+    uint64_t bucket(int i) const { return buckets_[i]; }
+
+    // upper bound of bucket which includes p-th percentile (0 < p <= 100)
+    uint64_t percentile(double p) const {
+	uint64_t target = static_cast<uint64_t>(n_ * p / 100.0 + 0.5);
+	uint64_t acc = 0;
+	for (int i = 0; i < n_bucket; i++) {
+	    acc += buckets_[i];
+	    if (acc >= target && acc != 0) {
+		return std::min(upper_of(i), max_);
+	    }
+	}
+	return max_;
+    }
+
+    static int bucket_of(uint64_t v) {
+	if (v < n_sub) {
+	    return static_cast<int>(v);
+	}
+	int e = 63 - __builtin_clzll(v);	// e >= sub_bits
+	int shift = e - sub_bits;
+	return (shift + 1) * n_sub + static_cast<int>((v >> shift) & (n_sub - 1));
+    }
+
+    static uint64_t upper_of(int i) {
+	if (i < n_sub) {
+	    return i;
+	}
+	int shift = i / n_sub - 1;
+	uint64_t lower = uint64_t(n_sub + i % n_sub) << shift;
+	return lower + ((uint64_t(1) << shift) - 1);
+    }
+
+    // formattable
+    void print(std::ostream& out, const std::string&) const {
+	c7::format(out, "n:%{}, mean:%{}, p50:%{}, p99:%{}, max:%{}",
+		   n_, mean(), percentile(50), percentile(99), max_);
+    }
+
+private:
+    uint64_t buckets_[n_bucket] = {};
+    uint64_t n_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+
+} // namespace c7
+
+
+#endif // c7utils/histogram.hpp
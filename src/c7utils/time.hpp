@@ -43,6 +43,14 @@ private:
 
 c7::usec_t time_us();
 
+// monotonic clock in nano seconds (for measuring duration)
+inline int64_t monotonic_ns()
+{
+    ::timespec ts;
+    (void)::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
 c7::usec_t sleep_us(c7::usec_t duration);
 
 inline c7::usec_t sleep_ms(c7::usec_t duration_ms)